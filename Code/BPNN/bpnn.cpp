@@ -28,10 +28,12 @@
 #include "bpnn.h"
 #include "bpnnDlg.h"
 #include "neuralNetwork.h"
+#include "optimizer.h"
 
 #include <vector>
 #include <string>
 #include <fstream>
+#include <algorithm>
 using std::vector;
 using std::string;
 
@@ -67,10 +69,35 @@ bool BPNN::getInputSpecification(PlugInArgList*& pInArgList)
         VERIFY(pInArgList->addArg<string>("Model File", NULL, "Model that will be used for prediction."));
         VERIFY(pInArgList->addArg<string>("Input Data File", NULL, "Input data to train the BPNN."));
         VERIFY(pInArgList->addArg<string>("Output Model File", NULL, "Model generated by training will be saved in this file."));
+        VERIFY(pInArgList->addArg<string>("Model Format", string("Text"),
+            "Format of the saved model: Binary (fast to load) or Text. Both formats can be read for prediction."));
 
         VERIFY(pInArgList->addArg<double>("Learning Rate", static_cast<double>(0.3)));
         VERIFY(pInArgList->addArg<double>("Momentum", static_cast<double>(0.3)));
         VERIFY(pInArgList->addArg<int>("Iterations", static_cast<int>(100)));
+        VERIFY(pInArgList->addArg<string>("Optimizer", string("SGD"),
+            "Weight update rule: SGD (with momentum), Nesterov, RMSProp or Adam."));
+        VERIFY(pInArgList->addArg<string>("Learning Rate Schedule", string("Constant"),
+            "How the learning rate changes with the iterations: Constant, Step, Exponential or Inverse Time."));
+        VERIFY(pInArgList->addArg<double>("Decay Rate", static_cast<double>(0.95),
+            "Decay factor used by the learning rate schedule."));
+        VERIFY(pInArgList->addArg<int>("Decay Step", static_cast<int>(10),
+            "Number of iterations between decays of the Step schedule."));
+        VERIFY(pInArgList->addArg<bool>("Shuffle", static_cast<bool>(false),
+            "True to split the data randomly and to visit the train set in a new random order every iteration."));
+        VERIFY(pInArgList->addArg<bool>("Stratified Batches", static_cast<bool>(false),
+            "True to spread every class evenly over each iteration so mini-batches hold all classes."));
+        VERIFY(pInArgList->addArg<int>("Batch Size", static_cast<int>(1),
+            "Number of training examples per weight update."));
+        VERIFY(pInArgList->addArg<int>("Random Seed", static_cast<int>(0),
+            "Seed for the weight initialization and shuffling, the same seed reproduces a training run."));
+        VERIFY(pInArgList->addArg<double>("Validation Fraction", static_cast<double>(0.0),
+            "Fraction of the train set held out to check the error after every iteration. 0 holds out nothing."));
+        VERIFY(pInArgList->addArg<int>("Patience", static_cast<int>(0),
+            "Training stops when the validation error has not improved for this many iterations. 0 disables early stopping."));
+        VERIFY(pInArgList->addArg<double>("Tolerance", static_cast<double>(0.0),
+            "Training stops when the relative change in the error sum between iterations falls below this value. "
+            "0 disables the test."));
     }
     return true;
 }
@@ -92,7 +119,16 @@ bool BPNN::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 
     double learningRate, momentum;
     int iterations;
-    string inputFileName, outputModelFileName, modelFileName;
+    double validationFraction, tolerance;
+    int patience;
+    string optimizerName, scheduleName;
+    OptimizerType optimizerType;
+    LearningRateSchedule schedule;
+    double decayRate;
+    int decayStep;
+    bool shuffle, stratified;
+    int batchSize, seed;
+    string inputFileName, outputModelFileName, modelFileName, modelFormat;
     vector<Signature*> sigToPredict;
     bool isPredict;
     // If the application is executing in batch mode
@@ -114,6 +150,12 @@ bool BPNN::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
         {
             VERIFY(pInArgList->getPlugInArgValue("Input Data File", inputFileName) == true);
             VERIFY(pInArgList->getPlugInArgValue("Output Model File", outputModelFileName) == true);
+            VERIFY(pInArgList->getPlugInArgValue("Model Format", modelFormat) == true);
+            if (modelFormat != "Binary" && modelFormat != "Text")
+            {
+                progress.report("Invalid model format", 0, ERRORS, true);
+                return false;
+            }
             VERIFY(pInArgList->getPlugInArgValue("Learning Rate", learningRate) == true);
             if (learningRate < 0.0 || learningRate > 1.0)
             {
@@ -132,6 +174,47 @@ bool BPNN::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
                 progress.report("Invalid iterations", 0, ERRORS, true);
                 return false;
             }
+            VERIFY(pInArgList->getPlugInArgValue("Optimizer", optimizerName) == true);
+            VERIFY(pInArgList->getPlugInArgValue("Learning Rate Schedule", scheduleName) == true);
+            VERIFY(pInArgList->getPlugInArgValue("Decay Rate", decayRate) == true);
+            if (decayRate < 0.0)
+            {
+                progress.report("Invalid decay rate", 0, ERRORS, true);
+                return false;
+            }
+            VERIFY(pInArgList->getPlugInArgValue("Decay Step", decayStep) == true);
+            if (decayStep <= 0)
+            {
+                progress.report("Invalid decay step", 0, ERRORS, true);
+                return false;
+            }
+            VERIFY(pInArgList->getPlugInArgValue("Shuffle", shuffle) == true);
+            VERIFY(pInArgList->getPlugInArgValue("Stratified Batches", stratified) == true);
+            VERIFY(pInArgList->getPlugInArgValue("Batch Size", batchSize) == true);
+            if (batchSize <= 0)
+            {
+                progress.report("Invalid batch size", 0, ERRORS, true);
+                return false;
+            }
+            VERIFY(pInArgList->getPlugInArgValue("Random Seed", seed) == true);
+            VERIFY(pInArgList->getPlugInArgValue("Validation Fraction", validationFraction) == true);
+            if (validationFraction < 0.0 || validationFraction >= 1.0)
+            {
+                progress.report("Invalid validation fraction", 0, ERRORS, true);
+                return false;
+            }
+            VERIFY(pInArgList->getPlugInArgValue("Patience", patience) == true);
+            if (patience < 0)
+            {
+                progress.report("Invalid patience", 0, ERRORS, true);
+                return false;
+            }
+            VERIFY(pInArgList->getPlugInArgValue("Tolerance", tolerance) == true);
+            if (tolerance < 0.0)
+            {
+                progress.report("Invalid tolerance", 0, ERRORS, true);
+                return false;
+            }
         }
     }
     else
@@ -162,9 +245,21 @@ bool BPNN::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
         {
             inputFileName = bpnnDlg.getInputFileName();
             outputModelFileName = bpnnDlg.getOutputModelFileName();
+            modelFormat = bpnnDlg.getModelFormat();
             learningRate = bpnnDlg.getLearningRate();
             momentum = bpnnDlg.getMomentum();
             iterations = bpnnDlg.getIterations();
+            validationFraction = bpnnDlg.getValidationFraction();
+            patience = bpnnDlg.getPatience();
+            tolerance = bpnnDlg.getTolerance();
+            optimizerName = bpnnDlg.getOptimizer();
+            scheduleName = bpnnDlg.getLearningRateSchedule();
+            decayRate = bpnnDlg.getDecayRate();
+            decayStep = bpnnDlg.getDecayStep();
+            shuffle = bpnnDlg.getShuffle();
+            stratified = bpnnDlg.getStratified();
+            batchSize = bpnnDlg.getBatchSize();
+            seed = bpnnDlg.getSeed();
         }
     }
     // end extracting input arguments
@@ -184,29 +279,63 @@ bool BPNN::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
         {
             return false;
         }
-        vector<string> names, classes;
-
+        // Gather the reflectances into one contiguous buffer and predict them in a single call.
+        const unsigned int features = network.getFeatureCount();
+        vector<double> toPredict(sigToPredict.size()*features);
+        vector<bool> isValid(sigToPredict.size(), false);
         for (unsigned int i = 0; i < sigToPredict.size(); i++)
         {
             DataVariant reflectanceVariant = sigToPredict[i]->getData("Reflectance");
-            vector<double> toPredict;
-            reflectanceVariant.getValue(toPredict);
-            string prediction;
-            // Make prediction using the network
-            prediction = network.predict(toPredict);
+            vector<double> reflectance;
+            reflectanceVariant.getValue(reflectance);
+            if (reflectance.size() == features)
+            {
+                std::copy(reflectance.begin(), reflectance.end(), toPredict.begin() + i*features);
+                isValid[i] = true;
+            }
+        }
+        vector<int> classIds(sigToPredict.size());
+        vector<double> confidences(sigToPredict.size());
+        NeuralNetwork::Workspace workspace;
+        if (toPredict.empty() == false)
+        {
+            network.predict(&toPredict[0], sigToPredict.size(), &classIds[0], &confidences[0], workspace);
+        }
 
+        // Class names are only looked up for display.
+        vector<string> names, classes;
+        for (unsigned int i = 0; i < sigToPredict.size(); i++)
+        {
+            if (isValid[i] == false)
+            {
+                classIds[i] = NeuralNetwork::INVALID_SAMPLE;
+                confidences[i] = 0.0;
+            }
             names.push_back(sigToPredict[i]->getName());
-            classes.push_back(prediction);
+            classes.push_back(network.getClassName(classIds[i]));
         }
         // Display the results
-        predictionResultDlg predictionResultDlg(names, classes, Service<DesktopServices>()->getMainWidget());
+        predictionResultDlg predictionResultDlg(names, classes, confidences, Service<DesktopServices>()->getMainWidget());
         predictionResultDlg.exec();
         progress.report("Finished Prediction", 100, NORMAL, true);
     }
     else
     {
+        if (Optimizer::parseType(optimizerName, optimizerType) == false)
+        {
+            progress.report("Invalid optimizer " + optimizerName, 0, ERRORS, true);
+            return false;
+        }
+        if (Optimizer::parseSchedule(scheduleName, schedule) == false)
+        {
+            progress.report("Invalid learning rate schedule " + scheduleName, 0, ERRORS, true);
+            return false;
+        }
         // Create a new network
         NeuralNetwork network(this, learningRate, momentum, iterations);
+        network.setStoppingCriteria(validationFraction, patience, tolerance);
+        network.setOptimizer(optimizerType, schedule, decayRate, decayStep);
+        network.setSampling(shuffle, stratified, batchSize, seed);
 
         if (network.readData(inputFileName) == false)
         {
@@ -218,7 +347,10 @@ bool BPNN::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
             return false;
         }
         // Save the model
-        network.saveModel(outputModelFileName);
+        if (network.saveModel(outputModelFileName, modelFormat == "Binary") == false)
+        {
+            return false;
+        }
         progress.report("Finished training BPNN", 100, NORMAL, true);
     }
     return true;
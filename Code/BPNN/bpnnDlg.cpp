@@ -7,6 +7,7 @@
 * http://www.gnu.org/licenses/lgpl.html
 */
 
+#include <QtGui/QCheckBox>
 #include <QtGui/QComboBox>
 #include <QtGui/QDialogButtonBox>
 #include <QtGui/QFileDialog>
@@ -90,6 +91,102 @@ bpnnDlg::bpnnDlg(QWidget* pParent) : QDialog(pParent)
     mpIterations->setMinimum(1);
     mpIterations->setMaximum(std::numeric_limits<int>::max());
 
+    QLabel* pOptimizerLabel = new QLabel("Optimizer", this);
+    pOptimizerLabel->setToolTip("Rule used to update the weights after each training example.");
+    mpOptimizer = new QComboBox(this);
+    mpOptimizer->setToolTip(pOptimizerLabel->toolTip());
+    mpOptimizer->addItem("SGD");
+    mpOptimizer->addItem("Nesterov");
+    mpOptimizer->addItem("RMSProp");
+    mpOptimizer->addItem("Adam");
+    mpOptimizer->setEditable(false);
+
+    QLabel* pScheduleLabel = new QLabel("Learning Rate Schedule", this);
+    pScheduleLabel->setToolTip("How the learning rate changes with the iterations.");
+    mpSchedule = new QComboBox(this);
+    mpSchedule->setToolTip(pScheduleLabel->toolTip());
+    mpSchedule->addItem("Constant");
+    mpSchedule->addItem("Step");
+    mpSchedule->addItem("Exponential");
+    mpSchedule->addItem("Inverse Time");
+    mpSchedule->setEditable(false);
+
+    QLabel* pDecayRateLabel = new QLabel("Decay Rate", this);
+    pDecayRateLabel->setToolTip("Decay factor used by the learning rate schedule.");
+    mpDecayRate = new QDoubleSpinBox(this);
+    mpDecayRate->setToolTip(pDecayRateLabel->toolTip());
+    mpDecayRate->setDecimals(4);
+    mpDecayRate->setMinimum(0.0);
+    mpDecayRate->setMaximum(std::numeric_limits<double>::max());
+    mpDecayRate->setValue(0.95);
+
+    QLabel* pDecayStepLabel = new QLabel("Decay Step", this);
+    pDecayStepLabel->setToolTip("Number of iterations between decays of the Step schedule.");
+    mpDecayStep = new QSpinBox(this);
+    mpDecayStep->setToolTip(pDecayStepLabel->toolTip());
+    mpDecayStep->setMinimum(1);
+    mpDecayStep->setMaximum(std::numeric_limits<int>::max());
+    mpDecayStep->setValue(10);
+
+    mpShuffle = new QCheckBox("Shuffle", this);
+    mpShuffle->setToolTip("Split the data randomly and visit the train set in a new random order every iteration.");
+    mpShuffle->setChecked(false);
+
+    mpStratified = new QCheckBox("Stratified Batches", this);
+    mpStratified->setToolTip("Spread every class evenly over each iteration so mini-batches hold all classes.");
+    mpStratified->setChecked(false);
+
+    QLabel* pBatchSizeLabel = new QLabel("Batch Size", this);
+    pBatchSizeLabel->setToolTip("Number of training examples per weight update.");
+    mpBatchSize = new QSpinBox(this);
+    mpBatchSize->setToolTip(pBatchSizeLabel->toolTip());
+    mpBatchSize->setMinimum(1);
+    mpBatchSize->setMaximum(std::numeric_limits<int>::max());
+    mpBatchSize->setValue(1);
+
+    QLabel* pSeedLabel = new QLabel("Random Seed", this);
+    pSeedLabel->setToolTip("The same seed reproduces a training run.");
+    mpSeed = new QSpinBox(this);
+    mpSeed->setToolTip(pSeedLabel->toolTip());
+    mpSeed->setMinimum(0);
+    mpSeed->setMaximum(std::numeric_limits<int>::max());
+    mpSeed->setValue(0);
+
+    QLabel* pValidationFractionLabel = new QLabel("Validation Fraction", this);
+    pValidationFractionLabel->setToolTip("Fraction of the train set held out to check the error after every iteration.");
+    mpValidationFraction = new QDoubleSpinBox(this);
+    mpValidationFraction->setToolTip(pValidationFractionLabel->toolTip());
+    mpValidationFraction->setDecimals(2);
+    mpValidationFraction->setMinimum(0.0);
+    mpValidationFraction->setMaximum(0.9);
+    mpValidationFraction->setSingleStep(0.05);
+    mpValidationFraction->setValue(0.0);
+
+    QLabel* pPatienceLabel = new QLabel("Patience", this);
+    pPatienceLabel->setToolTip("Stop when the validation error has not improved for this many iterations. 0 disables early stopping.");
+    mpPatience = new QSpinBox(this);
+    mpPatience->setToolTip(pPatienceLabel->toolTip());
+    mpPatience->setMinimum(0);
+    mpPatience->setMaximum(std::numeric_limits<int>::max());
+    mpPatience->setValue(0);
+
+    QLabel* pToleranceLabel = new QLabel("Tolerance", this);
+    pToleranceLabel->setToolTip("Stop when the relative change in the error between iterations falls below this value. 0 disables the test.");
+    mpTolerance = new QDoubleSpinBox(this);
+    mpTolerance->setToolTip(pToleranceLabel->toolTip());
+    mpTolerance->setDecimals(6);
+    mpTolerance->setMinimum(0.0);
+    mpTolerance->setMaximum(1.0);
+    mpTolerance->setValue(0.0);
+
+    QLabel* pModelFormatLabel = new QLabel("Model Format", this);
+    pModelFormatLabel->setToolTip("Format of the saved model. Binary models load faster, text models can be inspected.");
+    mpModelFormat = new QComboBox(this);
+    mpModelFormat->setToolTip(pModelFormatLabel->toolTip());
+    mpModelFormat->addItem("Text");
+    mpModelFormat->addItem("Binary");
+    mpModelFormat->setEditable(false);
+
     QGridLayout* pTrainLayout = new QGridLayout;
     pTrainLayout->addWidget(pLearningRateLabel, 0, 0);
     pTrainLayout->addWidget(mpLearningRate, 0, 1);
@@ -97,10 +194,32 @@ bpnnDlg::bpnnDlg(QWidget* pParent) : QDialog(pParent)
     pTrainLayout->addWidget(mpMomentum, 1, 1);
     pTrainLayout->addWidget(pIterationsLabel, 2, 0);
     pTrainLayout->addWidget(mpIterations, 2, 1);
-    pTrainLayout->addWidget(pInputFileLabel, 3, 0);
-    pTrainLayout->addWidget(mpInputFile, 3, 1);
-    pTrainLayout->addWidget(pOutputFileLabel, 4, 0);
-    pTrainLayout->addWidget(mpOuputModelFile, 4, 1);
+    pTrainLayout->addWidget(pOptimizerLabel, 3, 0);
+    pTrainLayout->addWidget(mpOptimizer, 3, 1);
+    pTrainLayout->addWidget(pScheduleLabel, 4, 0);
+    pTrainLayout->addWidget(mpSchedule, 4, 1);
+    pTrainLayout->addWidget(pDecayRateLabel, 5, 0);
+    pTrainLayout->addWidget(mpDecayRate, 5, 1);
+    pTrainLayout->addWidget(pDecayStepLabel, 6, 0);
+    pTrainLayout->addWidget(mpDecayStep, 6, 1);
+    pTrainLayout->addWidget(mpShuffle, 7, 0);
+    pTrainLayout->addWidget(mpStratified, 7, 1);
+    pTrainLayout->addWidget(pBatchSizeLabel, 8, 0);
+    pTrainLayout->addWidget(mpBatchSize, 8, 1);
+    pTrainLayout->addWidget(pSeedLabel, 9, 0);
+    pTrainLayout->addWidget(mpSeed, 9, 1);
+    pTrainLayout->addWidget(pValidationFractionLabel, 10, 0);
+    pTrainLayout->addWidget(mpValidationFraction, 10, 1);
+    pTrainLayout->addWidget(pPatienceLabel, 11, 0);
+    pTrainLayout->addWidget(mpPatience, 11, 1);
+    pTrainLayout->addWidget(pToleranceLabel, 12, 0);
+    pTrainLayout->addWidget(mpTolerance, 12, 1);
+    pTrainLayout->addWidget(pInputFileLabel, 13, 0);
+    pTrainLayout->addWidget(mpInputFile, 13, 1);
+    pTrainLayout->addWidget(pOutputFileLabel, 14, 0);
+    pTrainLayout->addWidget(mpOuputModelFile, 14, 1);
+    pTrainLayout->addWidget(pModelFormatLabel, 15, 0);
+    pTrainLayout->addWidget(mpModelFormat, 15, 1);
     pTrainLayout->setMargin(10);
     pTrainLayout->setSpacing(5);
 
@@ -161,6 +280,66 @@ int bpnnDlg::getIterations() const
     return mpIterations->value();
 }
 
+double bpnnDlg::getValidationFraction() const
+{
+    return mpValidationFraction->value();
+}
+
+int bpnnDlg::getPatience() const
+{
+    return mpPatience->value();
+}
+
+double bpnnDlg::getTolerance() const
+{
+    return mpTolerance->value();
+}
+
+string bpnnDlg::getOptimizer() const
+{
+    return mpOptimizer->currentText().toStdString();
+}
+
+string bpnnDlg::getModelFormat() const
+{
+    return mpModelFormat->currentText().toStdString();
+}
+
+string bpnnDlg::getLearningRateSchedule() const
+{
+    return mpSchedule->currentText().toStdString();
+}
+
+double bpnnDlg::getDecayRate() const
+{
+    return mpDecayRate->value();
+}
+
+int bpnnDlg::getDecayStep() const
+{
+    return mpDecayStep->value();
+}
+
+bool bpnnDlg::getShuffle() const
+{
+    return mpShuffle->isChecked();
+}
+
+bool bpnnDlg::getStratified() const
+{
+    return mpStratified->isChecked();
+}
+
+int bpnnDlg::getBatchSize() const
+{
+    return mpBatchSize->value();
+}
+
+int bpnnDlg::getSeed() const
+{
+    return mpSeed->value();
+}
+
 string bpnnDlg::getInputFileName() const
 {
     return mpInputFile->getFilename().toStdString();
@@ -176,27 +355,30 @@ string bpnnDlg::getOutputModelFileName() const
     return mpOuputModelFile->getFilename().toStdString();
 }
 
-predictionResultDlg::predictionResultDlg(vector<string>& names, vector<string>& classes, QWidget* pParent)
+predictionResultDlg::predictionResultDlg(vector<string>& names, vector<string>& classes, vector<double>& confidences,
+    QWidget* pParent)
 {
     setWindowTitle("Prediction Results");
     QGridLayout* pBox = new QGridLayout(this);
     pBox->setMargin(10);
     pBox->setSpacing(5);
 
-    pResultTable = new QTableWidget(names.size(), 2, this);
+    pResultTable = new QTableWidget(names.size(), 3, this);
     pResultTable->verticalHeader()->hide();
     pResultTable->verticalHeader()->setDefaultSectionSize(20);
-    QStringList horizontalHeaderLabels(QStringList() << "Signature" << "Class");
+    QStringList horizontalHeaderLabels(QStringList() << "Signature" << "Class" << "Confidence");
     pResultTable->setHorizontalHeaderLabels(horizontalHeaderLabels);
     //  pResultTable->horizontalHeader()->setDefaultSectionSize(100);
     for (unsigned int i = 0; i < names.size(); i++)
     {
-        QTableWidgetItem *pNameItem, *pClassItem;
+        QTableWidgetItem *pNameItem, *pClassItem, *pConfidenceItem;
         pNameItem = new QTableWidgetItem(QString::fromStdString(names[i]));
         pClassItem = new QTableWidgetItem(QString::fromStdString(classes[i]));
+        pConfidenceItem = new QTableWidgetItem(QString::number(confidences[i], 'f', 3));
 
         pResultTable->setItem(i, 0, pNameItem);
         pResultTable->setItem(i, 1, pClassItem);
+        pResultTable->setItem(i, 2, pConfidenceItem);
     }
 
     pBox->addWidget(pResultTable, 0, 0);
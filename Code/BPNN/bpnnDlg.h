@@ -17,6 +17,7 @@
 #include<string>
 using std::string;
 
+class QCheckBox;
 class QComboBox;
 class QLineEdit;
 class QListWidget;
@@ -35,6 +36,18 @@ public:
     double getLearningRate() const;
     double getMomentum() const;
     int getIterations() const;
+    double getValidationFraction() const;
+    int getPatience() const;
+    double getTolerance() const;
+    string getOptimizer() const;
+    string getModelFormat() const;
+    string getLearningRateSchedule() const;
+    double getDecayRate() const;
+    int getDecayStep() const;
+    bool getShuffle() const;
+    bool getStratified() const;
+    int getBatchSize() const;
+    int getSeed() const;
     string getModelFileName() const;
     string getOutputModelFileName() const;
     string getInputFileName() const;
@@ -51,13 +64,26 @@ private:
     QDoubleSpinBox* mpLearningRate;
     QDoubleSpinBox* mpMomentum;
     QSpinBox* mpIterations;
+    QDoubleSpinBox* mpValidationFraction;
+    QSpinBox* mpPatience;
+    QDoubleSpinBox* mpTolerance;
+    QComboBox* mpOptimizer;
+    QComboBox* mpModelFormat;
+    QComboBox* mpSchedule;
+    QDoubleSpinBox* mpDecayRate;
+    QSpinBox* mpDecayStep;
+    QCheckBox* mpShuffle;
+    QCheckBox* mpStratified;
+    QSpinBox* mpBatchSize;
+    QSpinBox* mpSeed;
 };
 
 class predictionResultDlg : public QDialog
 {
     Q_OBJECT
 public:
-    predictionResultDlg(std::vector<string>& names, std::vector<string>& classes, QWidget* pParent = NULL);
+    predictionResultDlg(std::vector<string>& names, std::vector<string>& classes, std::vector<double>& confidences,
+        QWidget* pParent = NULL);
 private:
     QTableWidget* pResultTable;
 };
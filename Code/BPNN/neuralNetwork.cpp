@@ -13,13 +13,88 @@
 
 #include <vector>
 #include <string>
+#include <QtCore/QFile>
 #include <QtCore/QString>
 #include <fstream>
 #include <cmath>
 #include <cstdlib>
+#include <limits>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <cstring>
 using std::vector;
 using std::string;
 
+namespace
+{
+    // Layout of a binary model file, all values are in the byte order of the machine that wrote it:
+    //   modelHeader_t
+    //   class table: for each class an int id, an unsigned int name length and the name characters
+    //   mu, stdv, input weights and hidden weights as arrays of doubles, each starting at an offset
+    //   that is a multiple of MODEL_ALIGNMENT so the arrays can be used straight from a mapped file.
+    const char MODEL_MAGIC[4] = {'B', 'P', 'N', 'N'};
+    const unsigned int MODEL_VERSION = 1;
+    const unsigned int MODEL_BYTE_ORDER = 0x01020304;
+    const unsigned int MODEL_ALIGNMENT = 64;
+    const unsigned int SIGMOID_ACTIVATION = 0;
+    // Largest number of units in a layer of a model file, well within int
+    const unsigned int MAX_MODEL_UNITS = 1 << 20;
+
+    struct modelHeader_t
+    {
+        char magic[4];
+        unsigned int version;
+        unsigned int byteOrder;
+        unsigned int activation;
+        unsigned int inputUnits;
+        unsigned int hiddenUnits;
+        unsigned int outputUnits;
+        unsigned int classCount;
+        // Offsets in bytes from the start of the file
+        unsigned int classTableOffset;
+        unsigned int muOffset;
+        unsigned int stdvOffset;
+        unsigned int inputWeightOffset;
+        unsigned int hiddenWeightOffset;
+        unsigned int fileSize;
+        // Adler-32 of everything following the header
+        unsigned int checksum;
+    };
+
+    unsigned int alignOffset(unsigned int offset)
+    {
+        return (offset + MODEL_ALIGNMENT - 1)/MODEL_ALIGNMENT*MODEL_ALIGNMENT;
+    }
+
+    // True when an array of count doubles starting at offset is 8-byte aligned and ends before end
+    bool arrayFits(unsigned int offset, size_t count, unsigned int end)
+    {
+        return offset%sizeof(double) == 0 && offset <= end && count <= (end - offset)/sizeof(double);
+    }
+
+    unsigned int adler32(const unsigned char* pData, unsigned int size)
+    {
+        const unsigned int MOD_ADLER = 65521;
+        unsigned int a = 1, b = 0;
+        while (size > 0)
+        {
+            // Largest block for which b cannot overflow before the modulo
+            unsigned int block = std::min(size, 5552u);
+            size -= block;
+            for (unsigned int n = 0; n < block; n++)
+            {
+                a += pData[n];
+                b += a;
+            }
+            pData += block;
+            a %= MOD_ADLER;
+            b %= MOD_ADLER;
+        }
+        return (b << 16) | a;
+    }
+};
+
 // Read data, generated by classificationData plugin, for training the neural network.
 bool NeuralNetwork::readData(const string& inputFileName)
 {
@@ -48,25 +123,22 @@ bool NeuralNetwork::readData(const string& inputFileName)
         idToClass[id] = name;
     }
 
-    int p;
-    // 80% train set
-    for (p = 1; p <= 80*numberOfPoints/100; p++)
+    // 80% train set, 20% test set, part of the train set is held out for validation after every epoch.
+    // ClassificationData writes the classes in runs, so when shuffling the points are assigned randomly to the sets.
+    const int trainPoints = 80*numberOfPoints/100;
+    const int validationPoints = static_cast<int>(validationFraction*trainPoints);
+    vector<int> rank(numberOfPoints);
+    for (int p = 0; p < numberOfPoints; p++)
     {
-        plugin->progress.report("Reading input data", 100*p/numberOfPoints, NORMAL, true);
-        vector<double> point(dimension);
-        for (int i = 0; i < dimension; i++)
-        {
-            inputFile>>point[i];
-        }
-        inputFile>>id;
-
-        trainSet.push_back(point);
-        yTrain.push_back(id);
+        rank[p] = p;
+    }
+    if (shuffle == true)
+    {
+        random.shuffle(rank);
     }
-    // 20% test set
-    for (; p <= numberOfPoints; p++)
+    for (int p = 0; p < numberOfPoints; p++)
     {
-        plugin->progress.report("Reading input data", 100*p/numberOfPoints, NORMAL, true);
+        plugin->progress.report("Reading input data", 100*(p + 1)/numberOfPoints, NORMAL, true);
         vector<double> point(dimension);
         for (int i = 0; i < dimension; i++)
         {
@@ -74,8 +146,16 @@ bool NeuralNetwork::readData(const string& inputFileName)
         }
         inputFile>>id;
 
-        testSet.push_back(point);
-        yTest.push_back(id);
+        if (rank[p] < trainPoints)
+        {
+            trainSet.push_back(point);
+            yTrain.push_back(id);
+        }
+        else
+        {
+            testSet.push_back(point);
+            yTest.push_back(id);
+        }
     }
 
     inputFile>>dummy; 
@@ -84,11 +164,66 @@ bool NeuralNetwork::readData(const string& inputFileName)
         plugin->progress.report("Invalid input file", 0, ERRORS, true);
         return false;
     }
+
+    // Without shuffling the train set still holds the classes in runs, so the validation points are the tail
+    // of a stratified order, which takes them from every class in proportion.
+    if (validationPoints > 0 && validationPoints < static_cast<int>(trainSet.size()))
+    {
+        vector<unsigned int> order(trainSet.size());
+        stratifiedOrder(order);
+        vector<bool> validation(trainSet.size(), false);
+        for (unsigned int p = order.size() - validationPoints; p < order.size(); p++)
+        {
+            validation[order[p]] = true;
+        }
+        vector< vector<double> > remainingSet;
+        vector<int> yRemaining;
+        for (unsigned int p = 0; p < trainSet.size(); p++)
+        {
+            if (validation[p] == true)
+            {
+                validationSet.push_back(trainSet[p]);
+                yValidation.push_back(yTrain[p]);
+            }
+            else
+            {
+                remainingSet.push_back(trainSet[p]);
+                yRemaining.push_back(yTrain[p]);
+            }
+        }
+        trainSet.swap(remainingSet);
+        yTrain.swap(yRemaining);
+    }
     return true;
 }
 
-bool NeuralNetwork::saveModel(const string& outputModelFileName)
+void NeuralNetwork::setOptimizer(OptimizerType type, LearningRateSchedule schedule, double decay, int decayStep)
 {
+    inputOptimizer = Optimizer(type, learningRate, momentum, schedule, decay, decayStep);
+    hiddenOptimizer = Optimizer(type, learningRate, momentum, schedule, decay, decayStep);
+}
+
+void NeuralNetwork::setSampling(bool _shuffle, bool _stratified, unsigned int _batchSize, unsigned int seed)
+{
+    shuffle = _shuffle;
+    stratified = _stratified;
+    batchSize = (_batchSize > 0) ? _batchSize : 1;
+    random.setSeed(seed);
+}
+
+void NeuralNetwork::setStoppingCriteria(double _validationFraction, int _patience, double _tolerance)
+{
+    validationFraction = _validationFraction;
+    patience = _patience;
+    tolerance = _tolerance;
+}
+
+bool NeuralNetwork::saveModel(const string& outputModelFileName, bool binary)
+{
+    if (binary == true)
+    {
+        return saveBinaryModel(outputModelFileName);
+    }
     std::ofstream outputModelFile(outputModelFileName.c_str());
     if (outputModelFile.good() == false)
     {
@@ -122,7 +257,7 @@ bool NeuralNetwork::saveModel(const string& outputModelFileName)
     {
         for (int j = 0; j <= hiddenUnits; j++)
         {
-            outputModelFile<<inputWeight[i][j]<<"\t";
+            outputModelFile<<inputWeight[i*(hiddenUnits + 1) + j]<<"\t";
         }
         outputModelFile<<"\n";
     }
@@ -131,7 +266,7 @@ bool NeuralNetwork::saveModel(const string& outputModelFileName)
     {
         for (int j = 0; j <= outputUnits; j++)
         {
-            outputModelFile<<hiddenWeight[i][j]<<"\t";
+            outputModelFile<<hiddenWeight[i*(outputUnits + 1) + j]<<"\t";
         }
         outputModelFile<<"\n";
     }
@@ -140,12 +275,23 @@ bool NeuralNetwork::saveModel(const string& outputModelFileName)
 
 bool NeuralNetwork::readModel(const string& modelFileName)
 {
-    std::ifstream modelFile(modelFileName.c_str());
+    std::ifstream modelFile(modelFileName.c_str(), std::ios::binary);
     if (modelFile.good() == false)
     {
         plugin->progress.report("Invalid model file", 0, ERRORS, true);
         return false;
     }
+    // Binary models start with the magic number, anything else is read as a text model.
+    char magic[sizeof(MODEL_MAGIC)] = {0};
+    modelFile.read(magic, sizeof(magic));
+    if (modelFile.gcount() == sizeof(magic) && memcmp(magic, MODEL_MAGIC, sizeof(magic)) == 0)
+    {
+        modelFile.close();
+        return readBinaryModel(modelFileName);
+    }
+    modelFile.clear();
+    modelFile.seekg(0);
+
     int numberOfClasses;
     // Read the classes
     modelFile>>numberOfClasses;
@@ -178,24 +324,15 @@ bool NeuralNetwork::readModel(const string& modelFileName)
         stdv[i] = s;
     }
     // Read the input and hidden layer weights
-    for (int i = 0; i <= inputUnits; i++)
+    inputWeight.resize((inputUnits + 1)*(hiddenUnits + 1));
+    for (unsigned int n = 0; n < inputWeight.size(); n++)
     {
-        vector<double> x(hiddenUnits + 1);
-        for (int j = 0; j <= hiddenUnits; j++)
-        {
-            modelFile>>x[j];
-        }
-        inputWeight.push_back(x);
+        modelFile>>inputWeight[n];
     }
-
-    for (int i = 0; i <= hiddenUnits; i++)
+    hiddenWeight.resize((hiddenUnits + 1)*(outputUnits + 1));
+    for (unsigned int n = 0; n < hiddenWeight.size(); n++)
     {
-        vector<double> x(outputUnits + 1);
-        for (int j = 0; j <= outputUnits; j++)
-        {
-            modelFile>>x[j];
-        }
-        hiddenWeight.push_back(x);
+        modelFile>>hiddenWeight[n];
     }
 
     inputActiv.resize(inputUnits + 1);
@@ -205,16 +342,195 @@ bool NeuralNetwork::readModel(const string& modelFileName)
     outputActiv.resize(outputUnits + 1);
     outputActiv[0] = 1.0;
 
-    inputWeightDelta.resize(inputUnits + 1);
-    for (int i = 0; i <= inputUnits; i++)
+    return true;
+}
+
+bool NeuralNetwork::saveBinaryModel(const string& outputModelFileName)
+{
+    modelHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version = MODEL_VERSION;
+    header.byteOrder = MODEL_BYTE_ORDER;
+    header.activation = SIGMOID_ACTIVATION;
+    header.inputUnits = inputUnits;
+    header.hiddenUnits = hiddenUnits;
+    header.outputUnits = outputUnits;
+    header.classCount = idToClass.size();
+
+    // Compute the layout of the file
+    unsigned int offset = sizeof(header);
+    header.classTableOffset = offset;
+    for (std::map<int, string>::const_iterator it = idToClass.begin(); it != idToClass.end(); ++it)
+    {
+        offset += sizeof(int) + sizeof(unsigned int) + it->second.size();
+    }
+    header.muOffset = alignOffset(offset);
+    header.stdvOffset = alignOffset(header.muOffset + mu.size()*sizeof(double));
+    header.inputWeightOffset = alignOffset(header.stdvOffset + stdv.size()*sizeof(double));
+    header.hiddenWeightOffset = alignOffset(header.inputWeightOffset + inputWeight.size()*sizeof(double));
+    header.fileSize = header.hiddenWeightOffset + hiddenWeight.size()*sizeof(double);
+
+    vector<char> buffer(header.fileSize, 0);
+    char* pClassTable = &buffer[header.classTableOffset];
+    for (std::map<int, string>::const_iterator it = idToClass.begin(); it != idToClass.end(); ++it)
+    {
+        int id = it->first;
+        unsigned int length = it->second.size();
+        memcpy(pClassTable, &id, sizeof(id));
+        pClassTable += sizeof(id);
+        memcpy(pClassTable, &length, sizeof(length));
+        pClassTable += sizeof(length);
+        memcpy(pClassTable, it->second.data(), length);
+        pClassTable += length;
+    }
+    memcpy(&buffer[header.muOffset], &mu[0], mu.size()*sizeof(double));
+    memcpy(&buffer[header.stdvOffset], &stdv[0], stdv.size()*sizeof(double));
+    memcpy(&buffer[header.inputWeightOffset], &inputWeight[0], inputWeight.size()*sizeof(double));
+    memcpy(&buffer[header.hiddenWeightOffset], &hiddenWeight[0], hiddenWeight.size()*sizeof(double));
+    header.checksum = adler32(reinterpret_cast<const unsigned char*>(&buffer[sizeof(header)]),
+        header.fileSize - sizeof(header));
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    std::ofstream outputModelFile(outputModelFileName.c_str(), std::ios::binary);
+    if (outputModelFile.good() == false)
     {
-        inputWeightDelta[i].resize(hiddenUnits + 1, 0);
+        plugin->progress.report("Invalid output file", 0, ERRORS, true);
+        return false;
     }
-    hiddenWeightDelta.resize(hiddenUnits + 1);
-    for (int i = 0; i <= hiddenUnits; i++)
+    outputModelFile.write(&buffer[0], buffer.size());
+    if (outputModelFile.good() == false)
     {
-        hiddenWeightDelta[i].resize(outputUnits + 1, 0);
+        plugin->progress.report("Unable to write the model file", 0, ERRORS, true);
+        return false;
     }
+    return true;
+}
+
+bool NeuralNetwork::readBinaryModel(const string& modelFileName)
+{
+    QFile modelFile(QString::fromStdString(modelFileName));
+    if (modelFile.open(QIODevice::ReadOnly) == false)
+    {
+        plugin->progress.report("Invalid model file", 0, ERRORS, true);
+        return false;
+    }
+    const qint64 fileSize = modelFile.size();
+    modelHeader_t header;
+    if (fileSize < static_cast<qint64>(sizeof(header)))
+    {
+        plugin->progress.report("Truncated model file", 0, ERRORS, true);
+        return false;
+    }
+    // Map the file instead of reading it so the weights are copied straight from the page cache.
+    const unsigned char* pData = modelFile.map(0, fileSize);
+    if (pData == NULL)
+    {
+        plugin->progress.report("Unable to map the model file", 0, ERRORS, true);
+        return false;
+    }
+    memcpy(&header, pData, sizeof(header));
+
+    // The unit counts come from the file, check them before they size anything. Each factor of a weight
+    // array size is checked against the file size so the product cannot wrap.
+    const size_t fileDoubles = static_cast<size_t>(fileSize)/sizeof(double);
+    const bool validUnits = header.inputUnits <= MAX_MODEL_UNITS && header.hiddenUnits <= MAX_MODEL_UNITS
+        && header.outputUnits <= MAX_MODEL_UNITS
+        && header.inputUnits + 1 <= fileDoubles/(header.hiddenUnits + 1)
+        && header.hiddenUnits + 1 <= fileDoubles/(header.outputUnits + 1);
+    const size_t muSize = static_cast<size_t>(header.inputUnits) + 1;
+    const size_t inputWeightSize = validUnits ?
+        (static_cast<size_t>(header.inputUnits) + 1)*(static_cast<size_t>(header.hiddenUnits) + 1) : 0;
+    const size_t hiddenWeightSize = validUnits ?
+        (static_cast<size_t>(header.hiddenUnits) + 1)*(static_cast<size_t>(header.outputUnits) + 1) : 0;
+    string error;
+    if (header.version != MODEL_VERSION)
+    {
+        error = "Unsupported model file version";
+    }
+    else if (header.byteOrder != MODEL_BYTE_ORDER)
+    {
+        error = "Model file was written on a machine with a different byte order";
+    }
+    else if (header.activation != SIGMOID_ACTIVATION)
+    {
+        error = "Unsupported activation function in model file";
+    }
+    else if (validUnits == false || header.classCount != header.outputUnits)
+    {
+        error = "Corrupt model file layer sizes";
+    }
+    else if (header.fileSize != fileSize
+        || header.classTableOffset != sizeof(header)
+        || header.muOffset < header.classTableOffset
+        || arrayFits(header.muOffset, muSize, header.stdvOffset) == false
+        || arrayFits(header.stdvOffset, muSize, header.inputWeightOffset) == false
+        || arrayFits(header.inputWeightOffset, inputWeightSize, header.hiddenWeightOffset) == false
+        || arrayFits(header.hiddenWeightOffset, hiddenWeightSize, header.fileSize) == false)
+    {
+        error = "Corrupt model file layout";
+    }
+    else if (adler32(pData + sizeof(header), header.fileSize - sizeof(header)) != header.checksum)
+    {
+        error = "Model file checksum mismatch";
+    }
+    if (error.empty() == false)
+    {
+        modelFile.unmap(const_cast<unsigned char*>(pData));
+        plugin->progress.report(error, 0, ERRORS, true);
+        return false;
+    }
+
+    // Read the classes
+    const unsigned char* pClassTable = pData + header.classTableOffset;
+    const unsigned char* pClassTableEnd = pData + header.muOffset;
+    for (unsigned int i = 0; i < header.classCount; i++)
+    {
+        int id;
+        unsigned int length;
+        if (static_cast<unsigned int>(pClassTableEnd - pClassTable) < sizeof(id) + sizeof(length))
+        {
+            break;
+        }
+        memcpy(&id, pClassTable, sizeof(id));
+        pClassTable += sizeof(id);
+        memcpy(&length, pClassTable, sizeof(length));
+        pClassTable += sizeof(length);
+        if (static_cast<unsigned int>(pClassTableEnd - pClassTable) < length)
+        {
+            break;
+        }
+        string name(reinterpret_cast<const char*>(pClassTable), length);
+        pClassTable += length;
+        classNames.push_back(name);
+        idToClass[id] = name;
+    }
+    if (classNames.size() != header.classCount)
+    {
+        modelFile.unmap(const_cast<unsigned char*>(pData));
+        plugin->progress.report("Corrupt class table in model file", 0, ERRORS, true);
+        return false;
+    }
+
+    inputUnits = header.inputUnits;
+    hiddenUnits = header.hiddenUnits;
+    outputUnits = header.outputUnits;
+    const double* pMu = reinterpret_cast<const double*>(pData + header.muOffset);
+    mu.assign(pMu, pMu + muSize);
+    const double* pStdv = reinterpret_cast<const double*>(pData + header.stdvOffset);
+    stdv.assign(pStdv, pStdv + muSize);
+    const double* pInputWeight = reinterpret_cast<const double*>(pData + header.inputWeightOffset);
+    inputWeight.assign(pInputWeight, pInputWeight + inputWeightSize);
+    const double* pHiddenWeight = reinterpret_cast<const double*>(pData + header.hiddenWeightOffset);
+    hiddenWeight.assign(pHiddenWeight, pHiddenWeight + hiddenWeightSize);
+    modelFile.unmap(const_cast<unsigned char*>(pData));
+
+    inputActiv.resize(inputUnits + 1);
+    inputActiv[0] = 1.0;
+    hiddenActiv.resize(hiddenUnits + 1);
+    hiddenActiv[0] = 1.0;
+    outputActiv.resize(outputUnits + 1);
+    outputActiv[0] = 1.0;
 
     return true;
 }
@@ -253,13 +569,13 @@ void NeuralNetwork::normalizeFeatures()
             stdv[feature] = 1;
 }
 
-inline double NeuralNetwork::sigmoid(const double x)
+inline double NeuralNetwork::sigmoid(const double x) const
 {
     return 1.0/(1.0 + exp(-x));
 }
 
 // Derivative of the sigmoid function.
-inline double NeuralNetwork::dsigmoid(const double x)
+inline double NeuralNetwork::dsigmoid(const double x) const
 {
     return x*(1.0 - x);
 }
@@ -284,52 +600,41 @@ void NeuralNetwork::initialize()
     target.resize(outputUnits + 1);
 
     // Randomly initialize the weights randomly between -1.0 to 1.0
-    inputWeight.resize(inputUnits + 1);
-    for (int i = 0; i <= inputUnits; i++)
+    inputWeight.resize((inputUnits + 1)*(hiddenUnits + 1));
+    for (unsigned int n = 0; n < inputWeight.size(); n++)
     {
-        inputWeight[i].resize(hiddenUnits + 1);
-        for (int j = 0; j <= hiddenUnits; j++)
-        {
-            double x = (double)rand()/RAND_MAX;
-            inputWeight[i][j] = 2.0*x - 1.0;
-        }
+        double x = random.nextDouble();
+        inputWeight[n] = 2.0*x - 1.0;
     }
-    hiddenWeight.resize(hiddenUnits + 1);
-    for (int i = 0; i <= hiddenUnits; i++)
+    hiddenWeight.resize((hiddenUnits + 1)*(outputUnits + 1));
+    for (unsigned int n = 0; n < hiddenWeight.size(); n++)
     {
-        hiddenWeight[i].resize(outputUnits + 1);
-        for (int j = 0; j <= outputUnits; j++)
-        {
-            double x = (double)rand()/RAND_MAX;
-            hiddenWeight[i][j] = 2.0*x - 1.0;
-        }
+        double x = random.nextDouble();
+        hiddenWeight[n] = 2.0*x - 1.0;
     }
     // error terms
     hiddenDelta.resize(hiddenUnits + 1);
     outputDelta.resize(outputUnits + 1);
 
-    inputWeightDelta.resize(inputUnits + 1);
-    for (int i = 0; i <= inputUnits; i++)
-    {
-        inputWeightDelta[i].resize(hiddenUnits + 1, 0);
-    }
-    hiddenWeightDelta.resize(hiddenUnits + 1);
-    for (int i = 0; i <= hiddenUnits; i++)
-    {
-        hiddenWeightDelta[i].resize(outputUnits + 1, 0);
-    }
+    // Bias units (column 0) are never updated so their gradient stays 0.
+    inputGradient.assign(inputWeight.size(), 0.0);
+    hiddenGradient.assign(hiddenWeight.size(), 0.0);
+    inputOptimizer.initialize(inputWeight.size());
+    hiddenOptimizer.initialize(hiddenWeight.size());
 }
 
-void NeuralNetwork::feedForward()
+// Computes the hidden and output activations from the input activations.
+// Element 0 of input and hidden is the bias unit and must be set to 1.0 by the caller.
+void NeuralNetwork::feedForward(const double* input, double* hidden, double* output) const
 {
     for (int j = 1; j <= hiddenUnits; j++)
     {
         double z = 0.0;
         for (int i = 0; i <= inputUnits; i++)
         {
-            z += inputActiv[i]*inputWeight[i][j];
+            z += input[i]*inputWeight[i*(hiddenUnits + 1) + j];
         }
-        hiddenActiv[j] = sigmoid(z);
+        hidden[j] = sigmoid(z);
     }
 
     for (int j = 1; j <= outputUnits; j++)
@@ -337,9 +642,9 @@ void NeuralNetwork::feedForward()
         double z = 0.0;
         for (int i = 0; i <= hiddenUnits; i++)
         {
-            z += hiddenActiv[i]*hiddenWeight[i][j];
+            z += hidden[i]*hiddenWeight[i*(outputUnits + 1) + j];
         }
-        outputActiv[j] = sigmoid(z);
+        output[j] = sigmoid(z);
     }
 }
 
@@ -359,49 +664,121 @@ double NeuralNetwork::backPropagate()
         s = 0.0;
         for (int j = 1; j <= outputUnits; j++)
         {
-            s += outputDelta[j]*hiddenWeight[i][j];
+            s += outputDelta[j]*hiddenWeight[i*(outputUnits + 1) + j];
         }
         hiddenDelta[i] = dsigmoid(hiddenActiv[i])*s;
         error += fabs(hiddenDelta[i]);
     }
-    // Update weights for hidden unit.
-    double deltaW = 0.0;
-    for (int i = 1; i <= outputUnits; i++)
+    // Accumulate the gradients for hidden unit weights.
+    // The error terms point downhill so the gradient is their negative.
+    for (int j = 0; j <= hiddenUnits; j++)
     {
-        for (int j = 0; j <= hiddenUnits; j++)
+        double* gradient = &hiddenGradient[j*(outputUnits + 1)];
+        for (int i = 1; i <= outputUnits; i++)
         {
-            deltaW = learningRate*outputDelta[i]*hiddenActiv[j] + momentum*hiddenWeightDelta[j][i];
-            hiddenWeight[j][i] += deltaW;
-            hiddenWeightDelta[j][i] = deltaW;
+            gradient[i] -= outputDelta[i]*hiddenActiv[j];
         }
     }
-    // Update weights for input unit.
-    for (int i = 1; i <= hiddenUnits; i++)
+    // Accumulate the gradients for input unit weights.
+    for (int j = 0; j <= inputUnits; j++)
     {
-        for (int j = 0; j <= inputUnits; j++)
+        double* gradient = &inputGradient[j*(hiddenUnits + 1)];
+        for (int i = 1; i <= hiddenUnits; i++)
         {
-            deltaW = learningRate*hiddenDelta[i]*inputActiv[j] + momentum*inputWeightDelta[j][i];
-            inputWeight[j][i] += deltaW;
-            inputWeightDelta[j][i] = deltaW;
+            gradient[i] -= hiddenDelta[i]*inputActiv[j];
         }
     }
     return error;
 }
 
+// Update the weights with the mean of the gradients accumulated over the last batchCount points.
+void NeuralNetwork::updateWeights(unsigned int batchCount)
+{
+    if (batchCount > 1)
+    {
+        const double scale = 1.0/batchCount;
+        for (unsigned int n = 0; n < hiddenGradient.size(); n++)
+        {
+            hiddenGradient[n] *= scale;
+        }
+        for (unsigned int n = 0; n < inputGradient.size(); n++)
+        {
+            inputGradient[n] *= scale;
+        }
+    }
+    hiddenOptimizer.update(hiddenWeight, hiddenGradient);
+    inputOptimizer.update(inputWeight, inputGradient);
+    std::fill(hiddenGradient.begin(), hiddenGradient.end(), 0.0);
+    std::fill(inputGradient.begin(), inputGradient.end(), 0.0);
+}
+
+// Shuffle each class separately and interleave the classes by spacing the points of each class
+// evenly over the epoch, so that every contiguous batch of order is stratified.
+void NeuralNetwork::stratifiedOrder(vector<unsigned int>& order)
+{
+    std::map<int, vector<unsigned int> > classIndices;
+    for (unsigned int p = 0; p < yTrain.size(); p++)
+    {
+        classIndices[yTrain[p]].push_back(p);
+    }
+    vector< std::pair<double, unsigned int> > keys;
+    keys.reserve(yTrain.size());
+    for (std::map<int, vector<unsigned int> >::iterator it = classIndices.begin(); it != classIndices.end(); ++it)
+    {
+        vector<unsigned int>& indices = it->second;
+        random.shuffle(indices);
+        double offset = random.nextDouble();
+        for (unsigned int k = 0; k < indices.size(); k++)
+        {
+            keys.push_back(std::make_pair((k + offset)/indices.size(), indices[k]));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    for (unsigned int p = 0; p < keys.size(); p++)
+    {
+        order[p] = keys[p].second;
+    }
+}
+
 bool NeuralNetwork::train()
 {
     // Initialize the network
     initialize();
 
     normalizeFeatures();
+
+    // Weights of the epoch with the lowest validation error
+    double bestValidationError = std::numeric_limits<double>::max();
+    int bestIteration = 0;
+    vector<double> bestInputWeight, bestHiddenWeight;
+    int epochsWithoutImprovement = 0;
+    double previousErrorSum = 0.0;
+
+    // The train set is visited through this index array so the points never move.
+    vector<unsigned int> order(trainSet.size());
+    for (unsigned int p = 0; p < order.size(); p++)
+    {
+        order[p] = p;
+    }
  
 	plugin->progress.report("Training Neural Network", 0, NORMAL, true);
     for (int iteration = 1; iteration <= iterations; iteration++)
     {
+        inputOptimizer.setEpoch(iteration - 1);
+        hiddenOptimizer.setEpoch(iteration - 1);
+        if (stratified == true)
+        {
+            stratifiedOrder(order);
+        }
+        else if (shuffle == true)
+        {
+            random.shuffle(order);
+        }
         double  errorSum = 0.0;
         // Train on all examples in the trainSet
-        for (unsigned int p = 0; p < trainSet.size(); p++)
+        for (unsigned int b = 0; b < order.size(); b++)
         {
+            const unsigned int p = order[b];
 
             if (plugin->isAborted() == true)
             {
@@ -425,73 +802,149 @@ bool NeuralNetwork::train()
             target[yTrain[p]] = HIGH;
 
             // set up the activation units
-            feedForward();
+            feedForward(&inputActiv[0], &hiddenActiv[0], &outputActiv[0]);
             // Train network using backpropagation.
             errorSum += backPropagate();
+            if ((b + 1)%batchSize == 0 || b + 1 == order.size())
+            {
+                updateWeights(b%batchSize + 1);
+            }
         }
         plugin->progress.report(QString("Error after iteration %1 = %2\n").arg(iteration).arg(errorSum).toStdString(), 100, WARNING, true);
+
+        if (validationSet.empty() == false)
+        {
+            double validationError = computeErrorRate(validationSet, yValidation);
+            plugin->progress.report(QString("Validation error after iteration %1 = %2\n").arg(iteration).arg(validationError).toStdString(), 100, WARNING, true);
+            if (validationError < bestValidationError)
+            {
+                bestValidationError = validationError;
+                bestIteration = iteration;
+                bestInputWeight = inputWeight;
+                bestHiddenWeight = hiddenWeight;
+                epochsWithoutImprovement = 0;
+            }
+            else if (patience > 0 && ++epochsWithoutImprovement >= patience)
+            {
+                plugin->progress.report(QString("No improvement in validation error for %1 iterations, stopping\n").arg(patience).toStdString(), 100, WARNING, true);
+                break;
+            }
+        }
+        // Stop when the error sum no longer changes noticeably between epochs.
+        if (tolerance > 0.0 && iteration > 1 && fabs(previousErrorSum - errorSum) <= tolerance*previousErrorSum)
+        {
+            plugin->progress.report(QString("Error converged after iteration %1\n").arg(iteration).toStdString(), 100, WARNING, true);
+            break;
+        }
+        previousErrorSum = errorSum;
+    }
+
+    // Restore the weights which performed best on the validation set.
+    if (bestIteration > 0)
+    {
+        inputWeight = bestInputWeight;
+        hiddenWeight = bestHiddenWeight;
+        plugin->progress.report(QString("Using weights from iteration %1\n").arg(bestIteration).toStdString(), 100, WARNING, true);
     }
     
 	computeAccuracy();
     return true;
 }
+unsigned int NeuralNetwork::getFeatureCount() const
+{
+    return inputUnits;
+}
+
 // Predict using the network
-string NeuralNetwork::predict(vector<double>& toPredict)
+int NeuralNetwork::predict(const double* features, Workspace& workspace, double& confidence) const
 {
-    if (toPredict.size() != inputUnits)
+    if (workspace.input.size() != static_cast<size_t>(inputUnits) + 1 ||
+        workspace.hidden.size() != static_cast<size_t>(hiddenUnits) + 1 ||
+        workspace.output.size() != static_cast<size_t>(outputUnits) + 1)
     {
-        return "INVALID";
+        workspace.input.assign(inputUnits + 1, 1.0);
+        workspace.hidden.assign(hiddenUnits + 1, 1.0);
+        workspace.output.assign(outputUnits + 1, 1.0);
     }
+    double* input = &workspace.input[0];
     for (int i = 1; i <= inputUnits; i++)
     {
-        inputActiv[i] = (toPredict[i - 1] - mu[i])/stdv[i];
+        input[i] = (features[i - 1] - mu[i])/stdv[i];
     }
     // Calculate output activations
-    feedForward();
+    feedForward(input, &workspace.hidden[0], &workspace.output[0]);
 
-    int id = 0;
+    int id = UNKNOWN_CLASS;
     double best = 0;
     for (int i = 1; i <= outputUnits; i++)
     {
-        if (outputActiv[i] > best)
+        if (workspace.output[i] > best)
         {
-            best = outputActiv[i];
+            best = workspace.output[i];
             id = i;
         }
     }
+    confidence = best;
     // If no class matches
-    if (id == 0 || best < 0.5)
+    if (best < 0.5)
     {
-        return "UNKNOWN";
+        return UNKNOWN_CLASS;
     }
-    return idToClass[id];
+    return id;
 }
 
-void NeuralNetwork::computeAccuracy()
+void NeuralNetwork::predict(const double* features, unsigned int count, int* classIds, double* confidences,
+    Workspace& workspace) const
 {
-    int errors = 0.0;
-    for (unsigned int p = 0; p < trainSet.size(); p++)
+    for (unsigned int p = 0; p < count; p++)
     {
-        plugin->progress.report("Computing accuracy on train set", 100*(p+1)/trainSet.size(), NORMAL, true);
-        string prediction = predict(trainSet[p]);
-        if (prediction != idToClass[yTrain[p]])
-        {
-            errors++;
-        }
+        classIds[p] = predict(features + p*inputUnits, workspace, confidences[p]);
     }
-    double errorRate = 100*(double)errors/trainSet.size();
+}
+
+const string& NeuralNetwork::getClassName(int classId) const
+{
+    static const string unknown("UNKNOWN");
+    static const string invalid("INVALID");
+    if (classId == INVALID_SAMPLE)
+    {
+        return invalid;
+    }
+    std::map<int, string>::const_iterator it = idToClass.find(classId);
+    if (it == idToClass.end())
+    {
+        return unknown;
+    }
+    return it->second;
+}
+
+void NeuralNetwork::computeAccuracy()
+{
+    plugin->progress.report("Computing accuracy on train set", 0, NORMAL, true);
+    double errorRate = computeErrorRate(trainSet, yTrain);
     plugin->progress.report(QString("Train error = %1\n").arg(errorRate).toStdString(), 100, WARNING, true);
 
-    errors = 0;
-    for (unsigned int p = 0; p < testSet.size(); p++)
+    plugin->progress.report("Computing accuracy on test set", 0, NORMAL, true);
+    errorRate = computeErrorRate(testSet, yTest);
+    plugin->progress.report(QString("Test error = %1\n").arg(errorRate).toStdString(), 100, WARNING, true);
+}
+
+// Percentage of misclassified points in dataSet.
+double NeuralNetwork::computeErrorRate(const vector< vector<double> >& dataSet, const vector<int>& labels) const
+{
+    if (dataSet.empty() == true)
     {
-        plugin->progress.report("Computing accuracy on test set", 100*(p+1)/testSet.size(), NORMAL, true);
-        string prediction = predict(testSet[p]);
-        if (prediction != idToClass[yTest[p]])
+        return 0.0;
+    }
+    Workspace workspace;
+    int errors = 0;
+    for (unsigned int p = 0; p < dataSet.size(); p++)
+    {
+        double confidence;
+        if (predict(&dataSet[p][0], workspace, confidence) != labels[p])
         {
             errors++;
         }
     }
-    errorRate = 100*(double)errors/testSet.size();
-    plugin->progress.report(QString("Test error = %1\n").arg(errorRate).toStdString(), 100, WARNING, true);
+    return 100*(double)errors/dataSet.size();
 }
@@ -12,6 +12,8 @@
 
 #include "Progress.h"
 #include "bpnn.h"
+#include "optimizer.h"
+#include "RandomGenerator.h"
 #include <vector>
 #include <string>
 #include <map>
@@ -42,13 +44,20 @@ class NeuralNetwork
     vector<int> yTrain;
     vector< vector<double> > testSet;
     vector<int> yTest;
+    // Held out from the train set and evaluated after every epoch
+    vector< vector<double> > validationSet;
+    vector<int> yValidation;
 
-    // Weight matrix
-    vector< vector<double> > inputWeight;
-    vector< vector<double> > hiddenWeight;
-    // Change in weight matrix
-    vector< vector<double> > inputWeightDelta;
-    vector< vector<double> > hiddenWeightDelta;
+    // Weight matrices, stored row major in flat buffers so that the optimizer can update them in one pass.
+    // inputWeight[i*(hiddenUnits + 1) + j] connects input unit i to hidden unit j.
+    // hiddenWeight[i*(outputUnits + 1) + j] connects hidden unit i to output unit j.
+    vector<double> inputWeight;
+    vector<double> hiddenWeight;
+    // Gradient of the error w.r.t. each weight, same layout as the weights.
+    vector<double> inputGradient;
+    vector<double> hiddenGradient;
+    Optimizer inputOptimizer;
+    Optimizer hiddenOptimizer;
     // Error terms
     vector<double> hiddenDelta;
     vector<double> outputDelta;
@@ -57,31 +66,104 @@ class NeuralNetwork
     // training parameters
     double learningRate;
     double momentum;
+    // stopping criteria
+    double validationFraction;
+    int patience;
+    double tolerance;
+    // order in which the train set is visited
+    RandomGenerator random;
+    bool shuffle;
+    bool stratified;
+    unsigned int batchSize;
 
-    double sigmoid(const double x);
-    double dsigmoid(const double x);
+    double sigmoid(const double x) const;
+    double dsigmoid(const double x) const;
 
     void normalizeFeatures();
     void initialize();
-    void feedForward();
+    void feedForward(const double* input, double* hidden, double* output) const;
     double backPropagate();
+    void updateWeights(unsigned int batchCount);
+    void stratifiedOrder(vector<unsigned int>& order);
     void computeAccuracy();
+    double computeErrorRate(const vector< vector<double> >& dataSet, const vector<int>& labels) const;
+    bool saveBinaryModel(const string& outputModelFileName);
+    bool readBinaryModel(const string& modelFileName);
 
 public:
-    NeuralNetwork(BPNN* _plugin) : plugin(_plugin)
+    // Returned by predict() when no output unit is active enough.
+    static const int UNKNOWN_CLASS = 0;
+    // Class id for a sample with the wrong number of features. predict() cannot check the count
+    // of the features it is given, so the caller assigns it; getClassName() names it INVALID.
+    static const int INVALID_SAMPLE = -1;
+
+    // Activations used by predict(). Each thread needs its own workspace;
+    // once sized by the first call predict() does not allocate any more.
+    struct Workspace
+    {
+        vector<double> input;
+        vector<double> hidden;
+        vector<double> output;
+    };
+
+    NeuralNetwork(BPNN* _plugin) : plugin(_plugin),
+      iterations(0),
+      inputUnits(0),
+      hiddenUnits(0),
+      outputUnits(0),
+      inputOptimizer(SGD_MOMENTUM, 0.0, 0.0),
+      hiddenOptimizer(SGD_MOMENTUM, 0.0, 0.0),
+      learningRate(0.0),
+      momentum(0.0),
+      validationFraction(0.0),
+      patience(0),
+      tolerance(0.0),
+      shuffle(false),
+      stratified(false),
+      batchSize(1)
     {}
     NeuralNetwork(BPNN* _plugin, double _learningRate, double _momentum, int _iterations) :
       plugin(_plugin),
+      iterations(_iterations),
+      inputUnits(0),
+      hiddenUnits(0),
+      outputUnits(0),
+      inputOptimizer(SGD_MOMENTUM, _learningRate, _momentum),
+      hiddenOptimizer(SGD_MOMENTUM, _learningRate, _momentum),
       learningRate(_learningRate),
       momentum(_momentum),
-      iterations(_iterations)
+      validationFraction(0.0),
+      patience(0),
+      tolerance(0.0),
+      shuffle(false),
+      stratified(false),
+      batchSize(1)
       {}
 
+    // Must be called before readData() since the validation set is split from the train set there.
+    // patience = 0 disables early stopping, tolerance = 0 disables the plateau test.
+    void setStoppingCriteria(double _validationFraction, int _patience, double _tolerance);
+    // Must be called before readData(). With shuffle the points are assigned randomly to the train and test sets
+    // and the train set is visited in a new random order every epoch. With stratified the order spreads every
+    // class evenly over the epoch so each mini-batch holds the classes in the proportion of the train set.
+    // The weights are updated once per batchSize points.
+    void setSampling(bool _shuffle, bool _stratified, unsigned int _batchSize, unsigned int seed);
+    // Select the weight update rule, SGD with momentum and a constant learning rate by default.
+    void setOptimizer(OptimizerType type, LearningRateSchedule schedule, double decay, int decayStep);
+
     bool train();
     bool readData(const string& inputFileName);
-    bool saveModel(const string& outputModelFileName);
+    // binary = false writes the tab separated text format. readModel() detects the format itself.
+    bool saveModel(const string& outputModelFileName, bool binary = false);
     bool readModel(const string& modelFileName);
-    std::string predict(vector<double>& toPredict);
+    unsigned int getFeatureCount() const;
+    // Class id of a single sample of getFeatureCount() features, confidence is the activation of the winning output unit.
+    int predict(const double* features, Workspace& workspace, double& confidence) const;
+    // Predict count samples stored contiguously in features, results are written to classIds and confidences.
+    void predict(const double* features, unsigned int count, int* classIds, double* confidences,
+        Workspace& workspace) const;
+    // Name of the class for a class id returned by predict().
+    const string& getClassName(int classId) const;
 };
 #endif
 
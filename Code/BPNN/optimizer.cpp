@@ -0,0 +1,164 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "optimizer.h"
+
+#include <cmath>
+#include <vector>
+#include <string>
+using std::vector;
+using std::string;
+
+namespace
+{
+    // Decay rates of the moment estimates and the term avoiding division by 0.
+    const double RMSPROP_DECAY = 0.9;
+    const double ADAM_BETA1 = 0.9;
+    const double ADAM_BETA2 = 0.999;
+    const double EPSILON = 1e-8;
+};
+
+Optimizer::Optimizer(OptimizerType _type, double _rate, double _momentum,
+    LearningRateSchedule _schedule, double _decay, int _decayStep) :
+    type(_type),
+    schedule(_schedule),
+    initialRate(_rate),
+    rate(_rate),
+    momentum(_momentum),
+    decay(_decay),
+    decayStep(_decayStep > 0 ? _decayStep : 1),
+    step(0)
+{}
+
+void Optimizer::initialize(unsigned int size)
+{
+    step = 0;
+    rate = initialRate;
+    velocity.assign(size, 0.0);
+    cache.assign(size, 0.0);
+}
+
+void Optimizer::setEpoch(int epoch)
+{
+    switch (schedule)
+    {
+    case STEP_DECAY:
+        rate = initialRate*pow(decay, epoch/decayStep);
+        break;
+    case EXPONENTIAL_DECAY:
+        rate = initialRate*pow(decay, epoch);
+        break;
+    case INVERSE_TIME_DECAY:
+        rate = initialRate/(1.0 + decay*epoch);
+        break;
+    default:
+        rate = initialRate;
+        break;
+    }
+}
+
+void Optimizer::update(vector<double>& weights, const vector<double>& gradient)
+{
+    const unsigned int size = weights.size();
+    double* w = &weights[0];
+    const double* g = &gradient[0];
+    double* v = &velocity[0];
+    double* c = &cache[0];
+    step++;
+
+    // Plain loops over contiguous buffers so the compiler can vectorize them.
+    switch (type)
+    {
+    case SGD_MOMENTUM:
+        for (unsigned int n = 0; n < size; n++)
+        {
+            v[n] = momentum*v[n] - rate*g[n];
+            w[n] += v[n];
+        }
+        break;
+    case NESTEROV_MOMENTUM:
+        // Look ahead form: w += -momentum*v(t-1) + (1 + momentum)*v(t)
+        for (unsigned int n = 0; n < size; n++)
+        {
+            double previous = v[n];
+            v[n] = momentum*v[n] - rate*g[n];
+            w[n] += (1.0 + momentum)*v[n] - momentum*previous;
+        }
+        break;
+    case RMSPROP:
+        for (unsigned int n = 0; n < size; n++)
+        {
+            c[n] = RMSPROP_DECAY*c[n] + (1.0 - RMSPROP_DECAY)*g[n]*g[n];
+            w[n] -= rate*g[n]/(sqrt(c[n]) + EPSILON);
+        }
+        break;
+    case ADAM:
+        {
+            // Fold the bias correction of both moments into the step size.
+            double correctedRate = rate*sqrt(1.0 - pow(ADAM_BETA2, step))/(1.0 - pow(ADAM_BETA1, step));
+            for (unsigned int n = 0; n < size; n++)
+            {
+                v[n] = ADAM_BETA1*v[n] + (1.0 - ADAM_BETA1)*g[n];
+                c[n] = ADAM_BETA2*c[n] + (1.0 - ADAM_BETA2)*g[n]*g[n];
+                w[n] -= correctedRate*v[n]/(sqrt(c[n]) + EPSILON);
+            }
+        }
+        break;
+    }
+}
+
+bool Optimizer::parseType(const string& name, OptimizerType& type)
+{
+    if (name == "SGD")
+    {
+        type = SGD_MOMENTUM;
+    }
+    else if (name == "Nesterov")
+    {
+        type = NESTEROV_MOMENTUM;
+    }
+    else if (name == "RMSProp")
+    {
+        type = RMSPROP;
+    }
+    else if (name == "Adam")
+    {
+        type = ADAM;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool Optimizer::parseSchedule(const string& name, LearningRateSchedule& schedule)
+{
+    if (name == "Constant")
+    {
+        schedule = CONSTANT_RATE;
+    }
+    else if (name == "Step")
+    {
+        schedule = STEP_DECAY;
+    }
+    else if (name == "Exponential")
+    {
+        schedule = EXPONENTIAL_DECAY;
+    }
+    else if (name == "Inverse Time")
+    {
+        schedule = INVERSE_TIME_DECAY;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string>
+#include <vector>
+using std::vector;
+using std::string;
+
+enum OptimizerType
+{
+    SGD_MOMENTUM,
+    NESTEROV_MOMENTUM,
+    RMSPROP,
+    ADAM
+};
+
+enum LearningRateSchedule
+{
+    CONSTANT_RATE,
+    STEP_DECAY,          // rate*decay^(epoch/decayStep)
+    EXPONENTIAL_DECAY,   // rate*decay^epoch
+    INVERSE_TIME_DECAY   // rate/(1 + decay*epoch)
+};
+
+// Updates a flat buffer of weights from a gradient of the same size.
+// Each weight buffer needs its own Optimizer since the optimizer keeps per weight state.
+class Optimizer
+{
+    OptimizerType type;
+    LearningRateSchedule schedule;
+    double initialRate;
+    double rate;
+    double momentum;
+    double decay;
+    int decayStep;
+    // Number of updates performed, used for bias correction in Adam.
+    int step;
+    // First moment (velocity for the momentum methods)
+    vector<double> velocity;
+    // Second moment (RMSProp and Adam)
+    vector<double> cache;
+
+public:
+    Optimizer(OptimizerType _type, double _rate, double _momentum,
+        LearningRateSchedule _schedule = CONSTANT_RATE, double _decay = 1.0, int _decayStep = 1);
+
+    // Reset the state for a buffer of the given size.
+    void initialize(unsigned int size);
+    // Compute the learning rate for the given (zero based) epoch from the schedule.
+    void setEpoch(int epoch);
+    // weights -= f(gradient) where gradient is the derivative of the error w.r.t. each weight.
+    void update(vector<double>& weights, const vector<double>& gradient);
+
+    static bool parseType(const string& name, OptimizerType& type);
+    static bool parseSchedule(const string& name, LearningRateSchedule& schedule);
+};
+
+#endif
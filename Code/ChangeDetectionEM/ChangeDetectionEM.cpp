@@ -35,11 +35,15 @@
 #include "ChangeDetectionEM.h"
 #include "GmmEM.h"
 #include "ChangeDetectionEMDlg.h"
+#include "ChangeVectorAnalysis.h"
+#include "MultivariateGmm.h"
 
 #include <QtCore/QString>
 #include <QtGui/QInputDialog>
 #include <QtGui/QMessageBox>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <string>
 #include <vector>
@@ -48,37 +52,151 @@ REGISTER_PLUGIN_BASIC(SpectralChangeDetectionEM, ChangeDetectionEM);
 
 namespace
 {
-    template<typename T>
-    void CVA(T* diff, void* _orig, void* _changed, unsigned int bands)
-    {
-        T* orig = reinterpret_cast<T*>(_orig);
-        T* changed = reinterpret_cast<T*>(_changed);
-        double result = 0.0;
-        *diff = static_cast<T>(0.0);
-        for (unsigned int band = 0; band < bands; ++band)
+    // Weight, mean and standard deviation of the values above (changed) and up to (unchanged) the threshold.
+    // When weights is not empty X[i] counts as weights[i] values.
+    void getInitialEstimates(const dataPoints_t& X, const dataPoints_t& weights, double threshold,
+        GMM& changed, GMM& unchanged)
+    {
+        double changeCount = 0.0, notChangeCount = 0.0;
+        double changeMean = 0.0, notChangeMean = 0.0;
+        for (unsigned int i = 0; i < X.size(); ++i)
         {
-            result += (changed[band] - orig[band])*(changed[band] - orig[band]);
+            double w = weights.empty() ? 1.0 : weights[i];
+            if (X[i] > threshold)
+            {
+                changeCount += w;
+                changeMean += w*X[i];
+            }
+            else
+            {
+                notChangeCount += w;
+                notChangeMean += w*X[i];
+            }
         }
-        result = sqrt(result);
-        *diff = static_cast<T>(result);
-    }
+        changeMean = changeMean/changeCount;
+        notChangeMean = notChangeMean/notChangeCount;
 
-    template<typename T>
-    void updadeMaxAndMin(T* pData, double& maxXd, double& minXd)
-    {
-        minXd = std::min(minXd, static_cast<double>(*pData));
-        maxXd = std::max(maxXd, static_cast<double>(*pData));
+        double changeStdDev = 0.0, notChangeStdDev = 0.0;
+        for (unsigned int i = 0; i < X.size(); ++i)
+        {
+            double w = weights.empty() ? 1.0 : weights[i];
+            if (X[i] > threshold)
+            {
+                changeStdDev += w*(X[i] - changeMean)*(X[i] - changeMean);
+            }
+            else
+            {
+                notChangeStdDev += w*(X[i] - notChangeMean)*(X[i] - notChangeMean);
+            }
+        }
+        double total = changeCount + notChangeCount;
+        changed = GMM(changeCount/total, changeMean, sqrt(changeStdDev/changeCount));
+        unchanged = GMM(notChangeCount/total, notChangeMean, sqrt(notChangeStdDev/notChangeCount));
     }
-    template<typename T>
-    void getValue(T* pData, double& p)
+
+    // Squared distance from the mean of a component of the multivariate GMM to the point of no change
+    double meanDistance(const MultivariateGmm& model, unsigned int component, const std::vector<double>& noChange)
     {
-        p = static_cast<double>(*pData);
+        double distance = 0.0;
+        for (unsigned int i = 0; i < model.dimensions; ++i)
+        {
+            double value = model.means[component*model.dimensions + i] - noChange[i];
+            distance += value*value;
+        }
+        return distance;
     }
 
-    template<typename T>
-    void setValue(T* pData, double& v)
+    // Fits the two class GMM to the magnitudes of one pair of images and returns the interval of the
+    // magnitudes of the changed class. EM starts from pWarmStart when it is not NULL, otherwise from
+    // the estimates of the classes split at half the range of the magnitudes.
+    // final is left empty when the magnitudes do not conform to a GMM.
+    decisionInterval_t fitChangeModel(const changeStats_t& stats, const dataPoints_t& X, unsigned int maxIterations,
+        double tolerance, const estimates_t* pWarmStart, estimates_t& final, ProgressTracker& progress)
     {
-        *pData = static_cast<T>(v);
+        const bool useHistogram = X.empty();
+        const Histogram& histogram = stats.histogram;
+        // Max and Min value in the difference image
+        // the initial Threshold will be T0 = (maxXd - minXd)/2
+        double minXd = stats.minValue;
+        double maxXd = stats.maxValue;
+
+        // Initial Estimates obtained by setting threshold = (maxXd - minXd)/2
+        double initialThreshold = (maxXd - minXd)/2;
+        // Changed
+        GMM wc;
+        // Unchanged
+        GMM wn;
+        if (useHistogram && histogram.skipped > 0)
+        {
+            progress.report(QString("%1 pixels with a NaN or infinite change magnitude were left out of the "
+                "histogram\n").arg(histogram.skipped).toStdString(), 0, WARNING, true);
+        }
+        if (useHistogram)
+        {
+            // The bin centers stand in for the values in the bins
+            dataPoints_t centers;
+            dataPoints_t counts;
+            histogram.getOccupiedBins(centers, counts);
+            getInitialEstimates(centers, counts, initialThreshold, wc, wn);
+        }
+        else
+        {
+            getInitialEstimates(X, dataPoints_t(), initialThreshold, wc, wn);
+        }
+        double notChangeStdDev = wn.stdDev;
+
+        final.clear();
+        // The decision is monotone between at most two thresholds on the magnitude of the change
+        decisionInterval_t changed;
+        // Run the EM only when the model conforms to GMM.
+        if (notChangeStdDev == 0)
+        {
+            // All unchanged pixels have the same value
+            changed.low = initialThreshold;
+            changed.high = std::numeric_limits<double>::infinity();
+            changed.inside = true;
+            return changed;
+        }
+
+        // The initial estimates for EM
+        estimates_t initial;
+        if (pWarmStart != NULL)
+        {
+            initial = *pWarmStart;
+        }
+        else
+        {
+            initial.push_back(wc);
+            initial.push_back(wn);
+        }
+
+        //Run EM algorithm on intial estimates
+        unsigned int iterations = 0;
+        double logLikelihood = 0.0;
+        if (useHistogram)
+        {
+            final = EM(initial, histogram, maxIterations, progress.getCurrentProgress(), tolerance,
+                &iterations, &logLikelihood);
+        }
+        else
+        {
+            final = EM(initial, X, maxIterations, progress.getCurrentProgress(), tolerance,
+                &iterations, &logLikelihood);
+        }
+
+        progress.report(QString("EM stopped after %1 iterations, log-likelihood = %2\n").arg(iterations).arg(logLikelihood).toStdString(), 0, WARNING, true);
+
+        progress.report(QString("Changed class weight = %1, mean = %2, stddev = %3\n").arg(final[0].weight).arg(final[0].mean).arg(final[0].stdDev).toStdString(), 0, WARNING, true);
+        progress.report(QString("Unchanged class weight = %1, mean = %2, stddev = %3\n").arg(final[1].weight).arg(final[1].mean).arg(final[1].stdDev).toStdString(), 0, WARNING, true);
+
+        const decisionInterval_t interval = getDecisionInterval(final[0], final[1]);
+        if (!(final[0].stdDev > 0.0) || !(final[1].stdDev > 0.0))
+        {
+            progress.report("The magnitudes do not conform to a GMM, no pixel is labelled as changed.\n", 0,
+                WARNING, true);
+            final.clear();
+        }
+        return interval;
     }
 };
 
@@ -103,6 +221,31 @@ bool ChangeDetectionEM::getInputSpecification(PlugInArgList*& pInArgList)
     VERIFY(pInArgList->addArg<Progress>(Executable::ProgressArg(), NULL, Executable::ProgressArgDescription()));
     VERIFY(pInArgList->addArg<RasterElement>("Original Image", NULL, "Raster element of the original image."));
     VERIFY(pInArgList->addArg<RasterElement>("Changed Image", NULL, "This changed image that will be used to detect changes."));
+    VERIFY(pInArgList->addArg<DataElementGroup>("Time Series", NULL, "Raster elements of three or more dates, "
+        "in date order. When given, the changes between every two consecutive dates are detected instead of "
+        "those between the original and the changed image."));
+    VERIFY(pInArgList->addArg<int>("Histogram Bins", static_cast<int>(1024), "Number of bins the difference image is "
+        "reduced to before running EM. 0 runs EM on every pixel."));
+    VERIFY(pInArgList->addArg<int>("EM Sample Size", static_cast<int>(0), "When histogram bins is 0, or with the "
+        "multivariate feature spaces, EM is fitted to a random sample of this many pixels, stratified by tile. "
+        "0 uses EM Sample Fraction."));
+    VERIFY(pInArgList->addArg<double>("EM Sample Fraction", static_cast<double>(0.0), "Fraction of the pixels "
+        "sampled when EM Sample Size is 0. 0 fits EM to every pixel."));
+    VERIFY(pInArgList->addArg<int>("Maximum EM Iterations", static_cast<int>(100), "Maximum number of EM iterations."));
+    VERIFY(pInArgList->addArg<double>("EM Tolerance", static_cast<double>(1e-6), "EM stops when the relative "
+        "improvement of the log-likelihood falls below this value."));
+    VERIFY(pInArgList->addArg<std::string>("Feature Space", std::string("Magnitude"), "Magnitude runs a two class "
+        "EM on the length of the change vectors. Band Differences and Principal Components fit a multivariate GMM "
+        "to the change vectors or to their principal components."));
+    VERIFY(pInArgList->addArg<int>("Principal Components", static_cast<int>(3), "Number of principal components "
+        "of the band differences kept when the feature space is Principal Components."));
+    VERIFY(pInArgList->addArg<int>("Change Classes", static_cast<int>(2), "Number of components of the multivariate "
+        "GMM, including the unchanged class, at most 256."));
+    VERIFY(pInArgList->addArg<std::string>("Covariance", std::string("Full"), "Full or Diagonal covariance "
+        "matrices of the multivariate GMM components."));
+    VERIFY(pInArgList->addArg<bool>("Out Of Core", false, "Write the change mask to disk and stream the images "
+        "tile by tile, so the memory used does not depend on their size. Needs the Magnitude feature space, and "
+        "histogram bins or an EM sample smaller than the images."));
     return true;
 }
 
@@ -110,7 +253,9 @@ bool ChangeDetectionEM::getOutputSpecification(PlugInArgList*& pOutArgList)
 {
     VERIFY(pOutArgList = Service<PlugInManagerServices>()->getPlugInArgList());
     VERIFY(pOutArgList->addArg<RasterElement>("Change Detection Results Element", NULL,
-        "This raster element will display the changed areas."));
+        "This raster element will display the changed areas: "
+        "255 for the unchanged pixels, 0 for the changed pixels, or 0 to Change Classes - 2 for the change classes "
+        "in increasing order of the magnitude of their change."));
     return true;
 }
 
@@ -129,6 +274,30 @@ bool ChangeDetectionEM::execute(PlugInArgList* pInArgList, PlugInArgList* pOutAr
     VERIFY(pInArgList->getPlugInArgValue("Original Image", pRasterElementOrig) == true);
     RasterElement* pRasterElementChanged = NULL;
     VERIFY(pInArgList->getPlugInArgValue("Changed Image", pRasterElementChanged) == true);
+    DataElementGroup* pTimeSeries = pInArgList->getPlugInArgValue<DataElementGroup>("Time Series");
+    int histogramBins = 0;
+    VERIFY(pInArgList->getPlugInArgValue("Histogram Bins", histogramBins) == true);
+    int sampleSize = 0;
+    VERIFY(pInArgList->getPlugInArgValue("EM Sample Size", sampleSize) == true);
+    double sampleFraction = 0.0;
+    VERIFY(pInArgList->getPlugInArgValue("EM Sample Fraction", sampleFraction) == true);
+    int maxIterations = 0;
+    VERIFY(pInArgList->getPlugInArgValue("Maximum EM Iterations", maxIterations) == true);
+    double tolerance = 0.0;
+    VERIFY(pInArgList->getPlugInArgValue("EM Tolerance", tolerance) == true);
+    std::string featureSpace;
+    VERIFY(pInArgList->getPlugInArgValue("Feature Space", featureSpace) == true);
+    int principalComponents = 0;
+    VERIFY(pInArgList->getPlugInArgValue("Principal Components", principalComponents) == true);
+    int changeClasses = 0;
+    VERIFY(pInArgList->getPlugInArgValue("Change Classes", changeClasses) == true);
+    std::string covariance;
+    VERIFY(pInArgList->getPlugInArgValue("Covariance", covariance) == true);
+    bool outOfCore = false;
+    VERIFY(pInArgList->getPlugInArgValue("Out Of Core", outOfCore) == true);
+
+    // Images of consecutive dates, the original and the changed image unless a time series is given
+    std::vector<RasterElement*> dates;
 
     // If not running in batch mode then show interactive dialog to select images
     if (isBatch() == false)
@@ -155,6 +324,16 @@ bool ChangeDetectionEM::execute(PlugInArgList* pInArgList, PlugInArgList* pOutAr
         }
 
         std::vector<std::string> selected = ChangeDetectionEMDlg.getSelectedRasters();
+        histogramBins = ChangeDetectionEMDlg.getHistogramBins();
+        sampleSize = ChangeDetectionEMDlg.getSampleSize();
+        sampleFraction = ChangeDetectionEMDlg.getSampleFraction();
+        maxIterations = ChangeDetectionEMDlg.getMaxIterations();
+        tolerance = ChangeDetectionEMDlg.getTolerance();
+        featureSpace = ChangeDetectionEMDlg.getFeatureSpace();
+        principalComponents = ChangeDetectionEMDlg.getPrincipalComponents();
+        changeClasses = ChangeDetectionEMDlg.getChangeClasses();
+        covariance = ChangeDetectionEMDlg.getCovariance();
+        outOfCore = ChangeDetectionEMDlg.isOutOfCore();
         int i = 0;
         for (std::vector<RasterElement*>::const_iterator it = rasters.begin(); it != rasters.end(); it++)
         {
@@ -166,225 +345,320 @@ bool ChangeDetectionEM::execute(PlugInArgList* pInArgList, PlugInArgList* pOutAr
             if (selected[1] == (*it)->getName())
                 pRasterElementChanged = (*it);
         }
+        std::vector<std::string> timeSeries = ChangeDetectionEMDlg.getTimeSeries();
+        for (std::vector<std::string>::const_iterator name = timeSeries.begin(); name != timeSeries.end(); ++name)
+        {
+            for (std::vector<RasterElement*>::const_iterator it = rasters.begin(); it != rasters.end(); it++)
+            {
+                if (*name == (*it)->getName())
+                    dates.push_back(*it);
+            }
+        }
     }
 
-    if (pRasterElementOrig == NULL)
+    if (dates.empty() && pTimeSeries != NULL)
+    {
+        std::vector<DataElement*> elements = pTimeSeries->getElements();
+        for (std::vector<DataElement*>::const_iterator it = elements.begin(); it != elements.end(); ++it)
+        {
+            RasterElement* pDate = dynamic_cast<RasterElement*>(*it);
+            if (pDate == NULL)
+            {
+                progress.report("The time series must only hold raster elements.", 0, ERRORS, true);
+                return false;
+            }
+            dates.push_back(pDate);
+        }
+    }
+    else if (dates.empty())
+    {
+        if (pRasterElementOrig == NULL)
+        {
+            progress.report("Invalid raster element for original image.", 0, ERRORS, true);
+            return false;
+        }
+        if (pRasterElementChanged == NULL)
+        {
+            progress.report("Invalid raster element for changed image.", 0, ERRORS, true);
+            return false;
+        }
+        dates.push_back(pRasterElementOrig);
+        dates.push_back(pRasterElementChanged);
+    }
+    if (dates.size() < 2)
+    {
+        progress.report("The time series must hold at least two images.", 0, ERRORS, true);
+        return false;
+    }
+    if (histogramBins < 0)
+    {
+        progress.report("Invalid number of histogram bins.", 0, ERRORS, true);
+        return false;
+    }
+    if (sampleSize < 0)
+    {
+        progress.report("Invalid EM sample size.", 0, ERRORS, true);
+        return false;
+    }
+    if (sampleFraction < 0.0 || sampleFraction > 1.0)
+    {
+        progress.report("Invalid EM sample fraction.", 0, ERRORS, true);
+        return false;
+    }
+    if (maxIterations <= 0)
     {
-        progress.report("Invalid raster element for original image.", 0, ERRORS, true);
+        progress.report("Invalid number of EM iterations.", 0, ERRORS, true);
         return false;
     }
-    if (pRasterElementChanged == NULL)
+    if (tolerance < 0.0)
     {
-        progress.report("Invalid raster element for changed image.", 0, ERRORS, true);
+        progress.report("Invalid EM tolerance.", 0, ERRORS, true);
         return false;
     }
-    RasterDataDescriptor* pDescriptorOrig = dynamic_cast<RasterDataDescriptor*>(pRasterElementOrig->getDataDescriptor());
-    RasterDataDescriptor* pDescriptorChanged = dynamic_cast<RasterDataDescriptor*>(pRasterElementChanged->getDataDescriptor());
-    if (pDescriptorOrig == NULL || pDescriptorChanged == NULL)
+    if (featureSpace != "Magnitude" && featureSpace != "Band Differences" && featureSpace != "Principal Components")
+    {
+        progress.report("Invalid feature space.", 0, ERRORS, true);
+        return false;
+    }
+    if (changeClasses < 2 || changeClasses > 256)
+    {
+        progress.report("Invalid number of change classes.", 0, ERRORS, true);
+        return false;
+    }
+    if (covariance != "Full" && covariance != "Diagonal")
+    {
+        progress.report("Invalid covariance type.", 0, ERRORS, true);
+        return false;
+    }
+    if (dates.size() > 2 && featureSpace != "Magnitude")
+    {
+        progress.report("Time series are only supported in the Magnitude feature space.", 0, ERRORS, true);
+        return false;
+    }
+    RasterDataDescriptor* pDescriptorOrig = dynamic_cast<RasterDataDescriptor*>(dates.front()->getDataDescriptor());
+    if (pDescriptorOrig == NULL)
     {
         progress.report("Invalid raster data descriptor.", 0, ERRORS, true);
         return false;
     }
+    for (std::vector<RasterElement*>::const_iterator it = dates.begin() + 1; it != dates.end(); ++it)
+    {
+        RasterDataDescriptor* pDescriptorChanged = dynamic_cast<RasterDataDescriptor*>((*it)->getDataDescriptor());
+        if (pDescriptorChanged == NULL)
+        {
+            progress.report("Invalid raster data descriptor.", 0, ERRORS, true);
+            return false;
+        }
+
+        if ((pDescriptorOrig->getRowCount() != pDescriptorChanged->getRowCount())
+            || (pDescriptorOrig->getColumnCount() != pDescriptorChanged->getColumnCount())
+            || (pDescriptorOrig->getBandCount() != pDescriptorChanged->getBandCount()))
+        {
+            progress.report(QString("Dimensions [%1][%2][%3] and [%4][%5][%6]").arg(pDescriptorOrig->getRowCount()).arg(pDescriptorOrig->getColumnCount()).arg(pDescriptorOrig->getBandCount()).
+                arg(pDescriptorChanged->getRowCount()).arg(pDescriptorChanged->getColumnCount()).arg(pDescriptorChanged->getBandCount()).toStdString(), 0, WARNING, true);
+            progress.report("All dimensions of images must be equal", 0, ERRORS, true);
+            return false;
+        }
+        if (pDescriptorOrig->getDataType() != pDescriptorChanged->getDataType())
+        {
+            progress.report("All images must have the same data type", 0, ERRORS, true);
+            return false;
+        }
+    }
+    if (featureSpace == "Principal Components" &&
+        (principalComponents <= 0 || principalComponents > static_cast<int>(pDescriptorOrig->getBandCount())))
+    {
+        progress.report("The number of principal components must be between 1 and the number of bands.", 0, ERRORS, true);
+        return false;
+    }
 
-    if ((pDescriptorOrig->getRowCount() != pDescriptorChanged->getRowCount())
-        || (pDescriptorOrig->getColumnCount() != pDescriptorChanged->getColumnCount())
-        || (pDescriptorOrig->getBandCount() != pDescriptorChanged->getBandCount()))
+    // A sample of every pixel would still hold all of them in memory.
+    const size_t pixelCount = static_cast<size_t>(pDescriptorOrig->getRowCount())*pDescriptorOrig->getColumnCount();
+    unsigned int sampleCount = static_cast<unsigned int>(sampleSize);
+    if (sampleCount == 0)
+    {
+        sampleCount = static_cast<unsigned int>(std::min<double>(pixelCount, ceil(sampleFraction*pixelCount)));
+    }
+    if (outOfCore && ((histogramBins == 0 && (sampleCount == 0 || sampleCount >= pixelCount))
+        || featureSpace != "Magnitude"))
     {
-        progress.report(QString("Dimensions [%1][%2][%3] and [%4][%5][%6]").arg(pDescriptorOrig->getRowCount()).arg(pDescriptorOrig->getColumnCount()).arg(pDescriptorOrig->getBandCount()).
-            arg(pDescriptorChanged->getRowCount()).arg(pDescriptorChanged->getColumnCount()).arg(pDescriptorChanged->getBandCount()).toStdString(), 0, WARNING, true);
-        progress.report("All dimensions of images must be equal", 0, ERRORS, true);
+        progress.report("Out of core change detection needs histogram bins or a sample smaller than the images, "
+            "and the Magnitude feature space.", 0, ERRORS, true);
         return false;
     }
 
-    // Create the RasterElement for Difference image (One band only)
-    ModelResource<RasterElement> pRasterElementDiff(dynamic_cast<RasterElement*>(Service<ModelServices>()->getElement(
+    // Create the RasterElement for the change mask (One band per pair of images)
+    ModelResource<RasterElement> pRasterElementResults(dynamic_cast<RasterElement*>(Service<ModelServices>()->getElement(
         "Change Detection Results", TypeConverter::toString<RasterElement>(), NULL)));
-    pRasterElementDiff = ModelResource<RasterElement>(reinterpret_cast<RasterElement*>(NULL));
-    pRasterElementDiff = ModelResource<RasterElement>(RasterUtilities::createRasterElement("Change Detection Results", pDescriptorOrig->getRowCount(),
-        pDescriptorOrig->getColumnCount(),FLT4BYTES));
-    if (pRasterElementDiff.get() == NULL)
+    pRasterElementResults = ModelResource<RasterElement>(reinterpret_cast<RasterElement*>(NULL));
+    pRasterElementResults = ModelResource<RasterElement>(RasterUtilities::createRasterElement("Change Detection Results",
+        pDescriptorOrig->getRowCount(), pDescriptorOrig->getColumnCount(), dates.size() - 1, INT1UBYTE, BIP, !outOfCore));
+    if (pRasterElementResults.get() == NULL)
     {
-        progress.report("Raster Element for Difference image could not be created.", 0, ERRORS, true);
+        progress.report("Raster Element for the change mask could not be created.", 0, ERRORS, true);
         return false;
     }
 
-    // Obtain accessors
-    FactoryResource<DataRequest> requestOrig;
-    requestOrig->setInterleaveFormat(BIP);
-    DataAccessor pAccOrig = pRasterElementOrig->getDataAccessor(requestOrig.release());
-    VERIFY(pAccOrig.isValid());
-
-    FactoryResource<DataRequest> requestChanged;
-    requestChanged->setInterleaveFormat(BIP);
-    DataAccessor pAccChanged = pRasterElementChanged->getDataAccessor(requestChanged.release());
-    VERIFY(pAccChanged.isValid());
-
-    FactoryResource<DataRequest> requestDiff;
-    requestDiff->setWritable(true);
-    DataAccessor pAccDiff = pRasterElementDiff->getDataAccessor(requestDiff.release());
-    VERIFY(pAccDiff.isValid());
-
-    // Max and Min value in the difference image
-    // the initial Threshold will be T0 = (maxXd - minXd)/2
-    double minXd = std::numeric_limits<double>::max();
-    double maxXd = -minXd;
+    if (featureSpace != "Magnitude")
+    {
+        if (detectChangeClasses(dates[0], dates[1], pRasterElementResults.get(),
+            featureSpace == "Principal Components" ? principalComponents : 0, changeClasses, covariance == "Diagonal",
+            sampleCount, maxIterations, tolerance, progress) == false ||
+            displayResults(pRasterElementResults.get(), progress) == false)
+        {
+            return false;
+        }
+        pOutArgList->setPlugInArgValue("Change Detection Results Element", dynamic_cast<RasterElement*>(pRasterElementResults.release()));
+        progress.upALevel();
+        return true;
+    }
 
-    // Obtain the difference image using CVA technique
+    // The pixel values of difference image are stored in X and passed to EM algorithm,
+    // or only counted in the histogram when EM runs on the histogram.
+    // With sampling X only holds a sample, EM then costs the same whatever the size of the images.
+    const unsigned int pairs = dates.size() - 1;
     unsigned int rowCount = pDescriptorOrig->getRowCount();
     unsigned int colCount = pDescriptorOrig->getColumnCount();
-    for (unsigned int row = 0; row < rowCount; row++)
-    {
-        progress.report("Performing Change Vector Analysis to obtain difference image", 100*row/rowCount, NORMAL, true);
-        for (unsigned int col = 0; col < colCount; col++)
-        {
-            switchOnEncoding(pDescriptorOrig->getDataType(), CVA, pAccDiff->getColumn(), pAccOrig->getColumn(),pAccChanged->getColumn()
-                , pDescriptorOrig->getBandCount());
+    std::vector<dataPoints_t> X;
+    std::vector<changeStats_t> stats;
 
-            switchOnEncoding(pDescriptorOrig->getDataType(), updadeMaxAndMin, pAccDiff->getColumn(), maxXd, minXd);
+    // Obtain the difference images using CVA technique. Everything EM needs is collected on the way,
+    // the difference images themselves are not stored.
+    if (computeSeriesChangeVectors(dates, histogramBins, sampleCount, stats, X, progress) == false)
+    {
+        return false;
+    }
 
-            pAccOrig->nextColumn();
-            pAccChanged->nextColumn();
-            pAccDiff->nextColumn();
-        }
-        pAccOrig->nextRow();
-        pAccChanged->nextRow();
-        pAccDiff->nextRow();
-    }
-
-    // Initial Estimates obtained by setting threshold = (maxXd - minXd)/2
-    double initialThreshold = (maxXd - minXd)/2;
-    double changeCount = 0.0, notChageCount = 0.0;
-    double changeWeight = 0.0, notChangeWeight = 0.0;
-    double changeMean = 0.0, notChangeMean = 0.0;
-    double changeStdDev = 0.0, notChangeStdDev = 0.0;
-    pAccDiff->toPixel(0,0);
-    for (unsigned int row = 0; row < rowCount; row++)
-    {
-        progress.report("Obtaining initial estimates", 50*row/rowCount, NORMAL, true);
-        for (unsigned int col = 0; col < colCount; col++)
+    // Consecutive pairs of a time series usually change alike, so EM starts from the model of the previous pair.
+    std::vector<decisionInterval_t> changed(pairs);
+    estimates_t previous;
+    for (unsigned int pair = 0; pair < pairs; ++pair)
+    {
+        if (pairs > 1)
         {
-            double p;
-            switchOnEncoding(pDescriptorOrig->getDataType(), getValue, pAccDiff->getColumn(), p);
-            if (p > initialThreshold)
-            {
-                changeCount++;
-                changeMean += p;
-            }
-            else
-            {
-                notChageCount++;
-                notChangeMean += p;
-            }
-            pAccDiff->nextColumn();
+            progress.report(QString("Fitting the change model of %1 and %2\n").arg(QString::fromStdString(
+                dates[pair]->getName())).arg(QString::fromStdString(dates[pair + 1]->getName())).toStdString(),
+                0, WARNING, true);
         }
-        pAccDiff->nextRow();
+        estimates_t final;
+        changed[pair] = fitChangeModel(stats[pair], X[pair], maxIterations, tolerance,
+            previous.empty() ? NULL : &previous, final, progress);
+        previous = final;
     }
-  
-    changeMean = changeMean/changeCount;
-    notChangeMean = notChangeMean/notChageCount;
-
-    // The pixel values of difference image are stored in X and passed to EM algorithm
-    dataPoints_t X;
 
-    pAccDiff->toPixel(0,0);
-    for (unsigned int row = 0; row < rowCount; row++)
+    if (X.front().size() != pixelCount)
     {
-        progress.report("Obtaining initial estimates", 51 + 50*row/rowCount, NORMAL, true);
-        for (unsigned int col = 0; col < colCount; col++)
+        // Stream the input images a second time instead of keeping the magnitudes
+        if (labelSeriesChangeVectors(dates, pRasterElementResults.get(), changed, progress) == false)
         {
-            double p;
-            switchOnEncoding(pDescriptorOrig->getDataType(), getValue, pAccDiff->getColumn(), p);
-            X.push_back(p);
-            if (p > initialThreshold)
-            {
-                changeStdDev += (p-changeMean)*(p-changeMean);
-            }
-            else
+            return false;
+        }
+    }
+    else
+    {
+        FactoryResource<DataRequest> requestResults;
+        requestResults->setInterleaveFormat(BIP);
+        requestResults->setWritable(true);
+        DataAccessor pAccResults = pRasterElementResults->getDataAccessor(requestResults.release());
+        VERIFY(pAccResults.isValid());
+        std::vector<unsigned char> labels(colCount);
+        for (unsigned int row = 0; row < rowCount; row++)
+        {
+            progress.report("Generating the change mask", 100*(row+1)/rowCount, NORMAL, true);
+            unsigned char* pMask = reinterpret_cast<unsigned char*>(pAccResults->getRow());
+            for (unsigned int pair = 0; pair < pairs; ++pair)
             {
-                notChangeStdDev += (p - notChangeMean)*(p - notChangeMean);
+                labelChanges(&X[pair][static_cast<size_t>(row)*colCount], &labels[0], colCount, changed[pair]);
+                for (unsigned int col = 0; col < colCount; col++)
+                {
+                    pMask[col*pairs + pair] = labels[col];
+                }
             }
-            pAccDiff->nextColumn();
+            pAccResults->nextRow();
         }
-        pAccDiff->nextRow();
     }
 
-    changeStdDev = sqrt(changeStdDev/changeCount);
-    notChangeStdDev = sqrt(notChangeStdDev/notChageCount);
-    changeWeight = double(changeCount)/(rowCount*colCount);
-    notChangeWeight = double(notChageCount)/(rowCount*colCount);
-
-    estimates_t final;
-    // Changed
-    GMM wc;
-    // Unchanged
-    GMM wn;
-    // Run the EM only when the model conforms to GMM.
-    if (notChangeStdDev != 0)
+    if (displayResults(pRasterElementResults.get(), progress) == false)
     {
-        // The initial estimates for EM
-        estimates_t initial;
-        initial.push_back(GMM(changeWeight, changeMean, changeStdDev));
-        initial.push_back(GMM(notChangeWeight, notChangeMean, notChangeStdDev));
-
-        //Run EM algorithm on intial estimates
-        final = EM(initial, X, 20, progress.getCurrentProgress());
+        return false;
+    }
+    pOutArgList->setPlugInArgValue("Change Detection Results Element", dynamic_cast<RasterElement*>(pRasterElementResults.release()));
+    progress.upALevel();
+    return true;
+}
 
-        progress.report(QString("Changed class weight = %1, mean = %2, stddev = %3\n").arg(final[0].weight).arg(final[0].mean).arg(final[0].stdDev).toStdString(), 0, WARNING, true);
-        progress.report(QString("Unchanged class weight = %1, mean = %2, stddev = %3\n").arg(final[1].weight).arg(final[1].mean).arg(final[1].stdDev).toStdString(), 0, WARNING, true);
+bool ChangeDetectionEM::detectChangeClasses(RasterElement* pOrig, RasterElement* pChanged, RasterElement* pResults,
+    unsigned int principalComponents, unsigned int changeClasses, bool diagonal, unsigned int sampleSize,
+    unsigned int maxIterations, double tolerance, ProgressTracker& progress)
+{
+    const RasterDataDescriptor* pDescriptor = static_cast<const RasterDataDescriptor*>(pOrig->getDataDescriptor());
+    VERIFY(pDescriptor != NULL);
+    unsigned int dimensions = pDescriptor->getBandCount();
 
-        // Changed
-        wc = final[0];
-        // Unchanged
-        wn = final[1];
+    std::vector<double> features;
+    if (computeChangeFeatures(pOrig, pChanged, sampleSize, features, progress) == false)
+    {
+        return false;
+    }
+    principalComponents_t components;
+    if (principalComponents > 0)
+    {
+        progress.report("Projecting the band differences on their principal components", 0, NORMAL, true);
+        findPrincipalComponents(features, dimensions, principalComponents, components);
+        projectPrincipalComponents(components, features);
+        dimensions = components.count;
     }
 
-    // Black if changed
-    double cv = 0.0;
-    // white if not changed
-    double nv = 255.0;
+    MultivariateGmm model(changeClasses, dimensions, diagonal);
+    if (model.fit(features, maxIterations, tolerance, progress.getCurrentProgress()) == false)
+    {
+        progress.report("The GMM could not be fitted, a covariance matrix is singular.", 0, ERRORS, true);
+        return false;
+    }
+    progress.report(QString("EM stopped after %1 iterations, log-likelihood = %2\n").arg(model.iterations)
+        .arg(model.logLikelihood).toStdString(), 0, WARNING, true);
+    // The pixels are labelled from the images, the features are not needed anymore
+    std::vector<double>().swap(features);
+
+    // Projection of the zero band difference. The principal components are centered on the mean difference,
+    // so no change is at -mean in their space rather than at the origin.
+    std::vector<double> noChange(dimensions, 0.0);
+    if (principalComponents > 0)
+    {
+        const std::vector<double> zero(components.dimensions, 0.0);
+        std::vector<double> work(components.dimensions);
+        projectFeature(components, &zero[0], &work[0], &noChange[0]);
+    }
 
-    pAccDiff->toPixel(0,0);
-    for (unsigned int row = 0; row < rowCount; row++)
+    // The component whose mean is closest to no change is the unchanged class, labelled 255 as in the
+    // Magnitude feature space. The other classes are labelled 0 to changeClasses - 2 in increasing order of
+    // the magnitude of their change, so that 0 is the changed class when there are two classes.
+    std::vector<std::pair<double, unsigned int> > order;
+    for (unsigned int c = 0; c < changeClasses; ++c)
     {
-        progress.report("Generating the difference image", 100*(row+1)/rowCount, NORMAL, true);
-        for (unsigned int col = 0; col < colCount; col++)
-        {
-            double p;
-            switchOnEncoding(pDescriptorOrig->getDataType(), getValue, pAccDiff->getColumn(), p);
-            // Check the class to which the pixel [row, column] belong
-            if (notChangeStdDev == 0)
-            {
-                if (p == notChangeMean)
-                {
-                    switchOnEncoding(pDescriptorOrig->getDataType(), setValue, pAccDiff->getColumn(), nv);
-                }
-                else
-                {
-                    switchOnEncoding(pDescriptorOrig->getDataType(), setValue, pAccDiff->getColumn(), cv);
-                }
-            }
-            else
-            {
-                if (wc.weight*wc.probabilityFunction(p) > wn.weight*wn.probabilityFunction(p))
-                {
-                    switchOnEncoding(pDescriptorOrig->getDataType(), setValue, pAccDiff->getColumn(), cv);
-                }
-                else
-                {
-                    switchOnEncoding(pDescriptorOrig->getDataType(), setValue, pAccDiff->getColumn(), nv);
-                }
-            }
-            pAccDiff->nextColumn();
-        }
-        pAccDiff->nextRow();
+        order.push_back(std::make_pair(meanDistance(model, c, noChange), c));
     }
+    std::sort(order.begin(), order.end());
+    std::vector<unsigned char> labels(changeClasses);
+    for (unsigned int rank = 0; rank < changeClasses; ++rank)
+    {
+        const unsigned int c = order[rank].second;
+        labels[c] = static_cast<unsigned char>(rank == 0 ? 255 : rank - 1);
+        progress.report(QString("Class %1 weight = %2, mean change = %3\n").arg(labels[c]).arg(model.weights[c])
+            .arg(sqrt(order[rank].first)).toStdString(), 0, WARNING, true);
+    }
+
+    return labelChangeClasses(pOrig, pChanged, pResults, model, principalComponents > 0 ? &components : NULL,
+        labels, progress);
+}
 
-    // Show results
+bool ChangeDetectionEM::displayResults(RasterElement* pResults, ProgressTracker& progress)
+{
     if (!isBatch())
     {
         Service<DesktopServices> pDesktop;
 
-        SpatialDataWindow* pWindow = static_cast<SpatialDataWindow*>(pDesktop->createWindow(pRasterElementDiff->getName(),
+        SpatialDataWindow* pWindow = static_cast<SpatialDataWindow*>(pDesktop->createWindow(pResults->getName(),
             SPATIAL_DATA_WINDOW));
 
         SpatialDataView* pView = (pWindow == NULL) ? NULL : pWindow->getSpatialDataView();
@@ -394,11 +668,9 @@ bool ChangeDetectionEM::execute(PlugInArgList* pInArgList, PlugInArgList* pOutAr
             return false;
         }
 
-        pView->setPrimaryRasterElement(pRasterElementDiff.get());
-        pView->createLayer(RASTER, pRasterElementDiff.get());
+        pView->setPrimaryRasterElement(pResults);
+        pView->createLayer(RASTER, pResults);
     }
-    pOutArgList->setPlugInArgValue("Change Detection Results Element", dynamic_cast<RasterElement*>(pRasterElementDiff.release()));
     progress.report("Change Detection complete", 100, NORMAL);
-    progress.upALevel();
     return true;
 }
@@ -12,6 +12,9 @@
 
 #include "AlgorithmShell.h"
 
+class ProgressTracker;
+class RasterElement;
+
 class ChangeDetectionEM : public AlgorithmShell
 {
 public:
@@ -20,6 +23,16 @@ public:
     virtual bool getInputSpecification(PlugInArgList*& pInArgList);
     virtual bool getOutputSpecification(PlugInArgList*& pOutArgList);
     virtual bool execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList);
+
+private:
+    // Fits a multivariate GMM to the band differences (or their first principalComponents components when
+    // not 0) of a sample of sampleSize pixels, or of every pixel when it is 0, and labels every pixel of
+    // pResults, tile by tile, with its component: 255 for the component whose mean is closest to the zero
+    // band difference (unchanged), 0 to changeClasses - 2 for the others in increasing order of that distance.
+    bool detectChangeClasses(RasterElement* pOrig, RasterElement* pChanged, RasterElement* pResults,
+        unsigned int principalComponents, unsigned int changeClasses, bool diagonal, unsigned int sampleSize,
+        unsigned int maxIterations, double tolerance, ProgressTracker& progress);
+    bool displayResults(RasterElement* pResults, ProgressTracker& progress);
 };
 
 #endif
\ No newline at end of file
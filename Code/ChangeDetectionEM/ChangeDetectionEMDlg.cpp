@@ -11,15 +11,23 @@
 #include "AppVerify.h"
 #include "ChangeDetectionEMDlg.h"
 
+#include <QtGui/QCheckBox>
 #include <QtGui/QComboBox>
+#include <QtGui/QDoubleSpinBox>
 #include <QtGui/QLabel>
 #include <QtGui/QLayout>
+#include <QtGui/QListWidget>
 #include <QtGui/QPushButton>
+#include <QtGui/QSpinBox>
+
+#include <limits>
 
 using namespace std;
 
 ChangeDetectionEMDlg::ChangeDetectionEMDlg(const vector<string>& rasters, QWidget* pParent) : QDialog(pParent),
-    mpComboOrig(NULL), mpComboChange(NULL)
+    mpComboOrig(NULL), mpComboChange(NULL), mpHistogramBins(NULL), mpSampleSize(NULL), mpSampleFraction(NULL),
+    mpMaxIterations(NULL), mpTolerance(NULL), mpFeatureSpace(NULL), mpPrincipalComponents(NULL),
+    mpChangeClasses(NULL), mpCovariance(NULL), mpOutOfCore(NULL), mpTimeSeries(NULL)
 {
     setModal(true);
     setWindowTitle("Change Detection");
@@ -54,10 +62,140 @@ ChangeDetectionEMDlg::ChangeDetectionEMDlg(const vector<string>& rasters, QWidge
     }
     mpComboChange->setEditable(false);
 
-    pLayout->setRowStretch(2, 10);
+    QLabel* pHistogramBinsLabel = new QLabel("Histogram Bins: ", this);
+    pHistogramBinsLabel->setToolTip("Number of bins the difference image is reduced to before running EM. "
+        "0 runs EM on every pixel.");
+    pLayout->addWidget(pHistogramBinsLabel, 2, 0);
+
+    mpHistogramBins = new QSpinBox(this);
+    mpHistogramBins->setToolTip(pHistogramBinsLabel->toolTip());
+    mpHistogramBins->setMinimum(0);
+    mpHistogramBins->setMaximum(1 << 20);
+    mpHistogramBins->setValue(1024);
+    pLayout->addWidget(mpHistogramBins, 2, 1, 1, 2);
+
+    QLabel* pSampleSizeLabel = new QLabel("EM Sample Size: ", this);
+    pSampleSizeLabel->setToolTip("When histogram bins is 0, EM is fitted to a random sample of this many pixels, "
+        "stratified by tile. 0 uses the sample fraction.");
+    pLayout->addWidget(pSampleSizeLabel, 3, 0);
+
+    mpSampleSize = new QSpinBox(this);
+    mpSampleSize->setToolTip(pSampleSizeLabel->toolTip());
+    mpSampleSize->setMinimum(0);
+    mpSampleSize->setMaximum(std::numeric_limits<int>::max());
+    mpSampleSize->setValue(0);
+    pLayout->addWidget(mpSampleSize, 3, 1, 1, 2);
+
+    QLabel* pSampleFractionLabel = new QLabel("EM Sample Fraction: ", this);
+    pSampleFractionLabel->setToolTip("Fraction of the pixels sampled when the sample size is 0. "
+        "0 fits EM to every pixel.");
+    pLayout->addWidget(pSampleFractionLabel, 4, 0);
+
+    mpSampleFraction = new QDoubleSpinBox(this);
+    mpSampleFraction->setToolTip(pSampleFractionLabel->toolTip());
+    mpSampleFraction->setDecimals(4);
+    mpSampleFraction->setMinimum(0.0);
+    mpSampleFraction->setMaximum(1.0);
+    mpSampleFraction->setSingleStep(0.01);
+    mpSampleFraction->setValue(0.0);
+    pLayout->addWidget(mpSampleFraction, 4, 1, 1, 2);
+
+    QLabel* pMaxIterationsLabel = new QLabel("Maximum EM Iterations: ", this);
+    pMaxIterationsLabel->setToolTip("Maximum number of EM iterations.");
+    pLayout->addWidget(pMaxIterationsLabel, 5, 0);
+
+    mpMaxIterations = new QSpinBox(this);
+    mpMaxIterations->setToolTip(pMaxIterationsLabel->toolTip());
+    mpMaxIterations->setMinimum(1);
+    mpMaxIterations->setMaximum(100000);
+    mpMaxIterations->setValue(100);
+    pLayout->addWidget(mpMaxIterations, 5, 1, 1, 2);
+
+    QLabel* pToleranceLabel = new QLabel("EM Tolerance: ", this);
+    pToleranceLabel->setToolTip("EM stops when the relative improvement of the log-likelihood falls below this value.");
+    pLayout->addWidget(pToleranceLabel, 6, 0);
+
+    mpTolerance = new QDoubleSpinBox(this);
+    mpTolerance->setToolTip(pToleranceLabel->toolTip());
+    mpTolerance->setDecimals(9);
+    mpTolerance->setMinimum(0.0);
+    mpTolerance->setMaximum(1.0);
+    mpTolerance->setSingleStep(1e-6);
+    mpTolerance->setValue(1e-6);
+    pLayout->addWidget(mpTolerance, 6, 1, 1, 2);
+
+    QLabel* pFeatureSpaceLabel = new QLabel("Feature Space: ", this);
+    pFeatureSpaceLabel->setToolTip("Magnitude runs a two class EM on the length of the change vectors. "
+        "Band Differences and Principal Components fit a multivariate GMM to the change vectors.");
+    pLayout->addWidget(pFeatureSpaceLabel, 7, 0);
+
+    mpFeatureSpace = new QComboBox(this);
+    mpFeatureSpace->setToolTip(pFeatureSpaceLabel->toolTip());
+    mpFeatureSpace->addItem("Magnitude");
+    mpFeatureSpace->addItem("Band Differences");
+    mpFeatureSpace->addItem("Principal Components");
+    mpFeatureSpace->setEditable(false);
+    pLayout->addWidget(mpFeatureSpace, 7, 1, 1, 2);
+
+    QLabel* pPrincipalComponentsLabel = new QLabel("Principal Components: ", this);
+    pPrincipalComponentsLabel->setToolTip("Number of principal components of the band differences kept.");
+    pLayout->addWidget(pPrincipalComponentsLabel, 8, 0);
+
+    mpPrincipalComponents = new QSpinBox(this);
+    mpPrincipalComponents->setToolTip(pPrincipalComponentsLabel->toolTip());
+    mpPrincipalComponents->setMinimum(1);
+    mpPrincipalComponents->setMaximum(1000);
+    mpPrincipalComponents->setValue(3);
+    pLayout->addWidget(mpPrincipalComponents, 8, 1, 1, 2);
+
+    QLabel* pChangeClassesLabel = new QLabel("Change Classes: ", this);
+    pChangeClassesLabel->setToolTip("Number of GMM components, including the unchanged class.");
+    pLayout->addWidget(pChangeClassesLabel, 9, 0);
+
+    mpChangeClasses = new QSpinBox(this);
+    mpChangeClasses->setToolTip(pChangeClassesLabel->toolTip());
+    mpChangeClasses->setMinimum(2);
+    mpChangeClasses->setMaximum(64);
+    mpChangeClasses->setValue(2);
+    pLayout->addWidget(mpChangeClasses, 9, 1, 1, 2);
+
+    QLabel* pCovarianceLabel = new QLabel("Covariance: ", this);
+    pCovarianceLabel->setToolTip("Estimate the full covariance matrices or only the variances of the GMM components.");
+    pLayout->addWidget(pCovarianceLabel, 10, 0);
+
+    mpCovariance = new QComboBox(this);
+    mpCovariance->setToolTip(pCovarianceLabel->toolTip());
+    mpCovariance->addItem("Full");
+    mpCovariance->addItem("Diagonal");
+    mpCovariance->setEditable(false);
+    pLayout->addWidget(mpCovariance, 10, 1, 1, 2);
+
+    mpOutOfCore = new QCheckBox("Out Of Core", this);
+    mpOutOfCore->setToolTip("Write the change mask to disk and stream the images tile by tile, so the memory used "
+        "does not depend on their size. Needs the Magnitude feature space, and histogram bins or an EM sample "
+        "smaller than the images.");
+    pLayout->addWidget(mpOutOfCore, 11, 0, 1, 3);
+
+    QLabel* pTimeSeriesLabel = new QLabel("Time Series: ", this);
+    pTimeSeriesLabel->setToolTip("Check three or more images to detect the changes between every two consecutive "
+        "dates instead of those between the original and the changed image. The checked images are used in list "
+        "order, drag them to put them in date order.");
+    pLayout->addWidget(pTimeSeriesLabel, 12, 0, Qt::AlignTop);
+
+    mpTimeSeries = new QListWidget(this);
+    mpTimeSeries->setToolTip(pTimeSeriesLabel->toolTip());
+    mpTimeSeries->setDragDropMode(QAbstractItemView::InternalMove);
+    for (vector<string>::const_iterator it = rasters.begin(); it != rasters.end(); ++it)
+    {
+        QListWidgetItem* pItem = new QListWidgetItem(QString::fromStdString(*it), mpTimeSeries);
+        pItem->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable | Qt::ItemIsDragEnabled);
+        pItem->setCheckState(Qt::Unchecked);
+    }
+    pLayout->addWidget(mpTimeSeries, 12, 1, 1, 2);
+    pLayout->setRowStretch(12, 10);
 
     QHBoxLayout* pRespLayout = new QHBoxLayout;
-    pLayout->addLayout(pRespLayout, 3, 0, 1, 3);
+    pLayout->addLayout(pRespLayout, 13, 0, 1, 3);
 
     QPushButton* pAccept = new QPushButton("OK", this);
     pRespLayout->addStretch();
@@ -91,3 +229,79 @@ vector<string> ChangeDetectionEMDlg::getSelectedRasters() const
     }
     return rasters;
 }
+
+
+int ChangeDetectionEMDlg::getHistogramBins() const
+{
+    VERIFYRV(mpHistogramBins != NULL, 0);
+    return mpHistogramBins->value();
+}
+
+int ChangeDetectionEMDlg::getSampleSize() const
+{
+    VERIFYRV(mpSampleSize != NULL, 0);
+    return mpSampleSize->value();
+}
+
+double ChangeDetectionEMDlg::getSampleFraction() const
+{
+    VERIFYRV(mpSampleFraction != NULL, 0.0);
+    return mpSampleFraction->value();
+}
+
+int ChangeDetectionEMDlg::getMaxIterations() const
+{
+    VERIFYRV(mpMaxIterations != NULL, 0);
+    return mpMaxIterations->value();
+}
+
+double ChangeDetectionEMDlg::getTolerance() const
+{
+    VERIFYRV(mpTolerance != NULL, 0.0);
+    return mpTolerance->value();
+}
+
+string ChangeDetectionEMDlg::getFeatureSpace() const
+{
+    VERIFYRV(mpFeatureSpace != NULL, string());
+    return mpFeatureSpace->currentText().toStdString();
+}
+
+int ChangeDetectionEMDlg::getPrincipalComponents() const
+{
+    VERIFYRV(mpPrincipalComponents != NULL, 0);
+    return mpPrincipalComponents->value();
+}
+
+int ChangeDetectionEMDlg::getChangeClasses() const
+{
+    VERIFYRV(mpChangeClasses != NULL, 0);
+    return mpChangeClasses->value();
+}
+
+string ChangeDetectionEMDlg::getCovariance() const
+{
+    VERIFYRV(mpCovariance != NULL, string());
+    return mpCovariance->currentText().toStdString();
+}
+
+bool ChangeDetectionEMDlg::isOutOfCore() const
+{
+    VERIFYRV(mpOutOfCore != NULL, false);
+    return mpOutOfCore->isChecked();
+}
+
+vector<string> ChangeDetectionEMDlg::getTimeSeries() const
+{
+    vector<string> rasters;
+    VERIFYRV(mpTimeSeries != NULL, rasters);
+    for (int row = 0; row < mpTimeSeries->count(); ++row)
+    {
+        QListWidgetItem* pItem = mpTimeSeries->item(row);
+        if (pItem->checkState() == Qt::Checked)
+        {
+            rasters.push_back(pItem->text().toStdString());
+        }
+    }
+    return rasters;
+}
\ No newline at end of file
@@ -17,6 +17,9 @@
 
 class QCheckBox;
 class QComboBox;
+class QDoubleSpinBox;
+class QListWidget;
+class QSpinBox;
 
 class ChangeDetectionEMDlg : public QDialog
 {
@@ -27,9 +30,32 @@ public:
     virtual ~ChangeDetectionEMDlg();
 
     std::vector<std::string> getSelectedRasters() const;
+    int getHistogramBins() const;
+    int getSampleSize() const;
+    double getSampleFraction() const;
+    int getMaxIterations() const;
+    double getTolerance() const;
+    std::string getFeatureSpace() const;
+    int getPrincipalComponents() const;
+    int getChangeClasses() const;
+    std::string getCovariance() const;
+    bool isOutOfCore() const;
+    // Names of the checked images of the time series, in the order of the list
+    std::vector<std::string> getTimeSeries() const;
 private:
     QComboBox* mpComboOrig;
     QComboBox* mpComboChange;
+    QSpinBox* mpHistogramBins;
+    QSpinBox* mpSampleSize;
+    QDoubleSpinBox* mpSampleFraction;
+    QSpinBox* mpMaxIterations;
+    QDoubleSpinBox* mpTolerance;
+    QComboBox* mpFeatureSpace;
+    QSpinBox* mpPrincipalComponents;
+    QSpinBox* mpChangeClasses;
+    QComboBox* mpCovariance;
+    QCheckBox* mpOutOfCore;
+    QListWidget* mpTimeSeries;
 };
 
 #endif
\ No newline at end of file
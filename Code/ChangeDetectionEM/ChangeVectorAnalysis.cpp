@@ -0,0 +1,574 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "AppVerify.h"
+#include "DataAccessor.h"
+#include "DataAccessorImpl.h"
+#include "DataRequest.h"
+#include "ObjectResource.h"
+#include "ProgressTracker.h"
+#include "RasterDataDescriptor.h"
+#include "RasterElement.h"
+#include "ChangeVectorAnalysis.h"
+#include "MultivariateGmm.h"
+#include "RandomGenerator.h"
+
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#ifndef QT_NO_CONCURRENT
+#include <QtCore/QtConcurrentMap>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+    // Approximate size of the part of all the input images read by a tile
+    const unsigned int TILE_BYTES = 4*1024*1024;
+
+    struct cvaTile_t
+    {
+        // Images of consecutive dates, the change vectors are computed between neighbours
+        std::vector<RasterElement*> dates;
+        // Change mask with one band per pair of dates written by labelSeriesChangeVectors(),
+        // NULL when only collecting statistics
+        RasterElement* pMask;
+        const std::vector<decisionInterval_t>* pDecisions;
+        unsigned int startRow;
+        unsigned int rowCount;
+        // Magnitude of the first pixel of the tile in X of each pair, NULL when X is not used
+        std::vector<double*> pX;
+        // When not 0, X only receives a uniform sample of this many magnitudes of the tile, kept in
+        // samples (one per pair) by reservoir sampling. The same pixels are sampled for every pair.
+        // computeChangeFeatures() keeps the band differences of the sampled pixels in samples[0].
+        unsigned int sampleQuota;
+        std::vector<dataPoints_t> samples;
+        unsigned int pixelsSeen;
+        RandomGenerator random;
+        // Set by computeChangeFeatures(), pFeatures receives the band differences of the first pixel of the
+        // tile unless they are sampled
+        bool collectFeatures;
+        double* pFeatures;
+        // Set by labelChangeClasses(), the pixels are labelled with the class of their component
+        const MultivariateGmm* pModel;
+        const principalComponents_t* pComponents;
+        const std::vector<unsigned char>* pClassLabels;
+        // Statistics of each pair of dates
+        std::vector<changeStats_t> stats;
+        bool success;
+    };
+
+    // Squared length of the difference of two spectra. The independent partial sums let the
+    // compiler keep several bands in flight and vectorize the loop.
+    template<typename T>
+    inline double squaredDistance(const T* pOrig, const T* pChanged, unsigned int bands)
+    {
+        double sums[4] = {0.0, 0.0, 0.0, 0.0};
+        unsigned int band = 0;
+        for (; band + 4 <= bands; band += 4)
+        {
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                const double d = static_cast<double>(pChanged[band + i]) - static_cast<double>(pOrig[band + i]);
+                sums[i] += d*d;
+            }
+        }
+        for (; band < bands; ++band)
+        {
+            const double d = static_cast<double>(pChanged[band]) - static_cast<double>(pOrig[band]);
+            sums[0] += d*d;
+        }
+        return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    }
+
+    void addRowStats(const float* pDiff, unsigned int columns, double* pX, changeStats_t& stats)
+    {
+        for (unsigned int col = 0; col < columns; ++col)
+        {
+            const double p = pDiff[col];
+            // Infinities (from infinite no data values) would stretch the range the initial estimates split
+            if (fabs(p) <= std::numeric_limits<double>::max())
+            {
+                stats.minValue = std::min(stats.minValue, p);
+                stats.maxValue = std::max(stats.maxValue, p);
+            }
+            if (pX != NULL)
+            {
+                pX[col] = p;
+            }
+            else
+            {
+                stats.histogram.add(p);
+            }
+        }
+    }
+
+    // Reservoir slot of each pixel of the next row of the tile, -1 for the pixels that are not sampled
+    void getSampleSlots(unsigned int columns, cvaTile_t& tile, std::vector<int>& slots)
+    {
+        for (unsigned int col = 0; col < columns; ++col, ++tile.pixelsSeen)
+        {
+            if (tile.pixelsSeen < tile.sampleQuota)
+            {
+                slots[col] = tile.pixelsSeen;
+            }
+            else
+            {
+                const unsigned int slot = tile.random.nextIndex(tile.pixelsSeen + 1);
+                slots[col] = (slot < tile.sampleQuota) ? static_cast<int>(slot) : -1;
+            }
+        }
+    }
+
+    void addRowSample(const float* pDiff, unsigned int columns, const std::vector<int>& slots, dataPoints_t& sample)
+    {
+        for (unsigned int col = 0; col < columns; ++col)
+        {
+            if (slots[col] >= 0)
+            {
+                sample[slots[col]] = pDiff[col];
+            }
+        }
+    }
+
+    // The first argument only selects the data type, the data is read through the accessors row by row.
+    // Every row of every date is read once and used for the pairs on both of its sides. Only one row of
+    // magnitudes is kept, they either go to the statistics or straight to the mask.
+    template<typename T>
+    void cvaTile(T*, std::vector<DataAccessor>& accDates, DataAccessor& accMask, unsigned int columns,
+        unsigned int bands, cvaTile_t& tile)
+    {
+        const unsigned int pairs = accDates.size() - 1;
+        std::vector<float> diff(columns);
+        std::vector<unsigned char> labels(pairs > 1 ? columns : 0);
+        std::vector<int> slots(tile.sampleQuota > 0 ? columns : 0);
+        for (unsigned int row = 0; row < tile.rowCount; ++row)
+        {
+            unsigned char* pMask = (tile.pMask != NULL) ? reinterpret_cast<unsigned char*>(accMask->getRow()) : NULL;
+            if (tile.sampleQuota > 0)
+            {
+                getSampleSlots(columns, tile, slots);
+            }
+            const T* pPrevious = reinterpret_cast<const T*>(accDates[0]->getRow());
+            for (unsigned int pair = 0; pair < pairs; ++pair)
+            {
+                const T* pOrig = pPrevious;
+                const T* pChanged = reinterpret_cast<const T*>(accDates[pair + 1]->getRow());
+                pPrevious = pChanged;
+                for (unsigned int col = 0; col < columns; ++col)
+                {
+                    diff[col] = static_cast<float>(sqrt(squaredDistance(pOrig, pChanged, bands)));
+                    pOrig += bands;
+                    pChanged += bands;
+                }
+                if (pMask == NULL && tile.sampleQuota > 0)
+                {
+                    addRowStats(&diff[0], columns, NULL, tile.stats[pair]);
+                    addRowSample(&diff[0], columns, slots, tile.samples[pair]);
+                }
+                else if (pMask == NULL)
+                {
+                    addRowStats(&diff[0], columns, tile.pX[pair] == NULL ? NULL : tile.pX[pair] + row*columns,
+                        tile.stats[pair]);
+                }
+                else if (pairs == 1)
+                {
+                    labelChanges(&diff[0], pMask, columns, (*tile.pDecisions)[pair]);
+                }
+                else
+                {
+                    // The mask is BIP, one band per pair
+                    labelChanges(&diff[0], &labels[0], columns, (*tile.pDecisions)[pair]);
+                    for (unsigned int col = 0; col < columns; ++col)
+                    {
+                        pMask[col*pairs + pair] = labels[col];
+                    }
+                }
+            }
+            for (unsigned int date = 0; date < accDates.size(); ++date)
+            {
+                accDates[date]->nextRow();
+            }
+            if (pMask != NULL)
+            {
+                accMask->nextRow();
+            }
+        }
+    }
+
+    // The first argument only selects the data type
+    template<typename T>
+    void featureTile(T*, DataAccessor& accOrig, DataAccessor& accChanged, unsigned int columns, unsigned int bands,
+        cvaTile_t& tile)
+    {
+        double* pFeatures = tile.pFeatures;
+        std::vector<int> slots(tile.sampleQuota > 0 ? columns : 0);
+        for (unsigned int row = 0; row < tile.rowCount; ++row)
+        {
+            const T* pOrig = reinterpret_cast<const T*>(accOrig->getRow());
+            const T* pChanged = reinterpret_cast<const T*>(accChanged->getRow());
+            if (tile.sampleQuota > 0)
+            {
+                getSampleSlots(columns, tile, slots);
+                for (unsigned int col = 0; col < columns; ++col)
+                {
+                    if (slots[col] >= 0)
+                    {
+                        double* pSample = &tile.samples[0][static_cast<size_t>(slots[col])*bands];
+                        for (unsigned int band = 0; band < bands; ++band)
+                        {
+                            pSample[band] = static_cast<double>(pChanged[col*bands + band]) -
+                                static_cast<double>(pOrig[col*bands + band]);
+                        }
+                    }
+                }
+            }
+            else
+            {
+                for (unsigned int value = 0; value < columns*bands; ++value)
+                {
+                    pFeatures[value] = static_cast<double>(pChanged[value]) - static_cast<double>(pOrig[value]);
+                }
+                pFeatures += columns*bands;
+            }
+            accOrig->nextRow();
+            accChanged->nextRow();
+        }
+    }
+
+    // The first argument only selects the data type. The band differences are computed again row by row,
+    // so the features of the whole images are never held at the same time.
+    template<typename T>
+    void classTile(T*, DataAccessor& accOrig, DataAccessor& accChanged, DataAccessor& accMask, unsigned int columns,
+        unsigned int bands, cvaTile_t& tile)
+    {
+        const MultivariateGmm& model = *tile.pModel;
+        const std::vector<unsigned char>& classLabels = *tile.pClassLabels;
+        std::vector<double> feature(bands);
+        std::vector<double> work(bands);
+        for (unsigned int row = 0; row < tile.rowCount; ++row)
+        {
+            const T* pOrig = reinterpret_cast<const T*>(accOrig->getRow());
+            const T* pChanged = reinterpret_cast<const T*>(accChanged->getRow());
+            unsigned char* pMask = reinterpret_cast<unsigned char*>(accMask->getRow());
+            for (unsigned int col = 0; col < columns; ++col)
+            {
+                for (unsigned int band = 0; band < bands; ++band)
+                {
+                    feature[band] = static_cast<double>(pChanged[band]) - static_cast<double>(pOrig[band]);
+                }
+                if (tile.pComponents != NULL)
+                {
+                    projectFeature(*tile.pComponents, &feature[0], &work[0], &feature[0]);
+                }
+                pMask[col] = classLabels[model.classify(&feature[0], &work[0])];
+                pOrig += bands;
+                pChanged += bands;
+            }
+            accOrig->nextRow();
+            accChanged->nextRow();
+            accMask->nextRow();
+        }
+    }
+
+    DataAccessor getTileAccessor(RasterElement* pElement, const cvaTile_t& tile, bool writable)
+    {
+        const RasterDataDescriptor* pDescriptor = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+        FactoryResource<DataRequest> pRequest;
+        pRequest->setInterleaveFormat(BIP);
+        pRequest->setRows(pDescriptor->getActiveRow(tile.startRow),
+            pDescriptor->getActiveRow(tile.startRow + tile.rowCount - 1), 1);
+        pRequest->setWritable(writable);
+        return pElement->getDataAccessor(pRequest.release());
+    }
+
+    void processTile(cvaTile_t& tile)
+    {
+        tile.success = false;
+        const RasterDataDescriptor* pDescriptor =
+            static_cast<const RasterDataDescriptor*>(tile.dates.front()->getDataDescriptor());
+        std::vector<DataAccessor> accDates;
+        for (std::vector<RasterElement*>::const_iterator date = tile.dates.begin(); date != tile.dates.end(); ++date)
+        {
+            accDates.push_back(getTileAccessor(*date, tile, false));
+            if (accDates.back().isValid() == false)
+            {
+                return;
+            }
+        }
+        if (tile.collectFeatures)
+        {
+            switchOnEncoding(pDescriptor->getDataType(), featureTile, accDates[0]->getRow(), accDates[0], accDates[1],
+                pDescriptor->getColumnCount(), pDescriptor->getBandCount(), tile);
+            tile.success = true;
+            return;
+        }
+        DataAccessor accMask(NULL, NULL);
+        if (tile.pMask != NULL)
+        {
+            accMask = getTileAccessor(tile.pMask, tile, true);
+            if (accMask.isValid() == false)
+            {
+                return;
+            }
+        }
+        if (tile.pModel != NULL)
+        {
+            switchOnEncoding(pDescriptor->getDataType(), classTile, accDates[0]->getRow(), accDates[0], accDates[1],
+                accMask, pDescriptor->getColumnCount(), pDescriptor->getBandCount(), tile);
+            tile.success = true;
+            return;
+        }
+        switchOnEncoding(pDescriptor->getDataType(), cvaTile, accDates[0]->getRow(), accDates, accMask,
+            pDescriptor->getColumnCount(), pDescriptor->getBandCount(), tile);
+        tile.success = true;
+    }
+
+    // Splits the rows of the images in tiles of about TILE_BYTES
+    std::vector<cvaTile_t> createTiles(const std::vector<RasterElement*>& dates)
+    {
+        const RasterDataDescriptor* pDescriptor =
+            static_cast<const RasterDataDescriptor*>(dates.front()->getDataDescriptor());
+        const unsigned int rowCount = pDescriptor->getRowCount();
+        const unsigned int rowBytes = pDescriptor->getColumnCount()*pDescriptor->getBandCount()*
+            pDescriptor->getBytesPerElement()*dates.size();
+        const unsigned int tileRows = std::max(1u, TILE_BYTES/std::max(1u, rowBytes));
+        const unsigned int pairs = dates.size() - 1;
+
+        changeStats_t empty;
+        empty.minValue = std::numeric_limits<double>::max();
+        empty.maxValue = -empty.minValue;
+        std::vector<cvaTile_t> tiles;
+        for (unsigned int startRow = 0; startRow < rowCount; startRow += tileRows)
+        {
+            cvaTile_t tile;
+            tile.dates = dates;
+            tile.pMask = NULL;
+            tile.pDecisions = NULL;
+            tile.startRow = startRow;
+            tile.rowCount = std::min(tileRows, rowCount - startRow);
+            tile.pX.assign(pairs, NULL);
+            tile.collectFeatures = false;
+            tile.pFeatures = NULL;
+            tile.pModel = NULL;
+            tile.pComponents = NULL;
+            tile.pClassLabels = NULL;
+            tile.sampleQuota = 0;
+            tile.pixelsSeen = 0;
+            tile.random.setSeed(startRow);
+            tile.stats.assign(pairs, empty);
+            tile.success = false;
+            tiles.push_back(tile);
+        }
+        return tiles;
+    }
+
+    std::vector<RasterElement*> getPair(RasterElement* pOrig, RasterElement* pChanged)
+    {
+        std::vector<RasterElement*> dates;
+        dates.push_back(pOrig);
+        dates.push_back(pChanged);
+        return dates;
+    }
+
+    // The tiles are handed to the thread pool a few at a time so the progress can be updated in between.
+    bool processTiles(std::vector<cvaTile_t>& tiles, const std::string& message, ProgressTracker& progress)
+    {
+        const unsigned int batchSize = 4*std::max(1, QThread::idealThreadCount());
+        for (unsigned int first = 0; first < tiles.size(); first += batchSize)
+        {
+            progress.report(message, 100*first/tiles.size(), NORMAL, true);
+            std::vector<cvaTile_t>::iterator batchBegin = tiles.begin() + first;
+            std::vector<cvaTile_t>::iterator batchEnd = tiles.begin() + std::min<size_t>(first + batchSize, tiles.size());
+#ifndef QT_NO_CONCURRENT
+            QtConcurrent::blockingMap(batchBegin, batchEnd, processTile);
+#else
+            std::for_each(batchBegin, batchEnd, processTile);
+#endif
+        }
+        for (std::vector<cvaTile_t>::const_iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+        {
+            if (tile->success == false)
+            {
+                progress.report(QString("Unable to access rows %1 to %2").arg(tile->startRow + 1)
+                    .arg(tile->startRow + tile->rowCount).toStdString(), 0, ERRORS, true);
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+bool computeChangeVectors(RasterElement* pOrig, RasterElement* pChanged, unsigned int histogramBins,
+    unsigned int sampleSize, changeStats_t& stats, dataPoints_t& X, ProgressTracker& progress)
+{
+    VERIFY(pOrig != NULL && pChanged != NULL);
+    std::vector<changeStats_t> pairStats;
+    std::vector<dataPoints_t> pairX;
+    if (computeSeriesChangeVectors(getPair(pOrig, pChanged), histogramBins, sampleSize, pairStats, pairX,
+        progress) == false)
+    {
+        return false;
+    }
+    stats = pairStats.front();
+    X.swap(pairX.front());
+    return true;
+}
+
+bool computeSeriesChangeVectors(const std::vector<RasterElement*>& dates, unsigned int histogramBins,
+    unsigned int sampleSize, std::vector<changeStats_t>& stats, std::vector<dataPoints_t>& X, ProgressTracker& progress)
+{
+    VERIFY(dates.size() >= 2);
+    const RasterDataDescriptor* pDescriptor = static_cast<const RasterDataDescriptor*>(dates.front()->getDataDescriptor());
+    VERIFY(pDescriptor != NULL);
+    const unsigned int colCount = pDescriptor->getColumnCount();
+    const unsigned int pairs = dates.size() - 1;
+    const size_t pixelCount = static_cast<size_t>(pDescriptor->getRowCount())*colCount;
+    const bool sampled = (histogramBins == 0 && sampleSize > 0 && sampleSize < pixelCount);
+
+    changeStats_t empty;
+    empty.minValue = std::numeric_limits<double>::max();
+    empty.maxValue = -empty.minValue;
+    empty.histogram = Histogram(histogramBins);
+    stats.assign(pairs, empty);
+    X.assign(pairs, dataPoints_t());
+    if (histogramBins == 0 && sampled == false)
+    {
+        for (unsigned int pair = 0; pair < pairs; ++pair)
+        {
+            X[pair].resize(pixelCount);
+        }
+    }
+
+    std::vector<cvaTile_t> tiles = createTiles(dates);
+    for (std::vector<cvaTile_t>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+    {
+        if (sampled)
+        {
+            // Stratified by tile: every tile contributes in proportion to its pixels
+            const size_t tilePixels = static_cast<size_t>(tile->rowCount)*colCount;
+            tile->sampleQuota = static_cast<unsigned int>(std::min<double>(tilePixels,
+                ceil(static_cast<double>(sampleSize)*tilePixels/pixelCount)));
+            tile->samples.assign(pairs, dataPoints_t(tile->sampleQuota));
+        }
+        for (unsigned int pair = 0; pair < pairs; ++pair)
+        {
+            tile->pX[pair] = (histogramBins == 0 && sampled == false) ?
+                &X[pair][static_cast<size_t>(tile->startRow)*colCount] : NULL;
+            tile->stats[pair].histogram = Histogram(histogramBins);
+        }
+    }
+    if (processTiles(tiles, "Performing Change Vector Analysis to obtain difference image", progress) == false)
+    {
+        return false;
+    }
+
+    for (std::vector<cvaTile_t>::const_iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+    {
+        for (unsigned int pair = 0; pair < pairs; ++pair)
+        {
+            stats[pair].minValue = std::min(stats[pair].minValue, tile->stats[pair].minValue);
+            stats[pair].maxValue = std::max(stats[pair].maxValue, tile->stats[pair].maxValue);
+            stats[pair].histogram.merge(tile->stats[pair].histogram);
+            if (sampled)
+            {
+                X[pair].insert(X[pair].end(), tile->samples[pair].begin(), tile->samples[pair].end());
+            }
+        }
+    }
+    return true;
+}
+
+bool computeChangeFeatures(RasterElement* pOrig, RasterElement* pChanged, unsigned int sampleSize,
+    std::vector<double>& features, ProgressTracker& progress)
+{
+    VERIFY(pOrig != NULL && pChanged != NULL);
+    const RasterDataDescriptor* pDescriptor = static_cast<const RasterDataDescriptor*>(pOrig->getDataDescriptor());
+    VERIFY(pDescriptor != NULL);
+    const unsigned int colCount = pDescriptor->getColumnCount();
+    const unsigned int bands = pDescriptor->getBandCount();
+    const size_t rowValues = static_cast<size_t>(colCount)*bands;
+    const size_t pixelCount = static_cast<size_t>(pDescriptor->getRowCount())*colCount;
+    const bool sampled = (sampleSize > 0 && sampleSize < pixelCount);
+    features.clear();
+    if (sampled == false)
+    {
+        features.resize(rowValues*pDescriptor->getRowCount());
+    }
+
+    std::vector<cvaTile_t> tiles = createTiles(getPair(pOrig, pChanged));
+    for (std::vector<cvaTile_t>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+    {
+        tile->collectFeatures = true;
+        if (sampled)
+        {
+            // Stratified by tile: every tile contributes in proportion to its pixels
+            const size_t tilePixels = static_cast<size_t>(tile->rowCount)*colCount;
+            tile->sampleQuota = static_cast<unsigned int>(std::min<double>(tilePixels,
+                ceil(static_cast<double>(sampleSize)*tilePixels/pixelCount)));
+            tile->samples.assign(1, dataPoints_t(static_cast<size_t>(tile->sampleQuota)*bands));
+        }
+        else
+        {
+            tile->pFeatures = &features[tile->startRow*rowValues];
+        }
+    }
+    if (processTiles(tiles, "Computing the band differences", progress) == false)
+    {
+        return false;
+    }
+    if (sampled)
+    {
+        for (std::vector<cvaTile_t>::const_iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+        {
+            features.insert(features.end(), tile->samples[0].begin(), tile->samples[0].end());
+        }
+    }
+    return true;
+}
+
+bool labelChangeClasses(RasterElement* pOrig, RasterElement* pChanged, RasterElement* pMask,
+    const MultivariateGmm& model, const principalComponents_t* pComponents,
+    const std::vector<unsigned char>& classLabels, ProgressTracker& progress)
+{
+    VERIFY(pOrig != NULL && pChanged != NULL && pMask != NULL && classLabels.size() == model.components);
+    std::vector<cvaTile_t> tiles = createTiles(getPair(pOrig, pChanged));
+    for (std::vector<cvaTile_t>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+    {
+        tile->pMask = pMask;
+        tile->pModel = &model;
+        tile->pComponents = pComponents;
+        tile->pClassLabels = &classLabels;
+    }
+    return processTiles(tiles, "Labelling the change classes", progress);
+}
+
+bool labelChangeVectors(RasterElement* pOrig, RasterElement* pChanged, RasterElement* pMask,
+    const decisionInterval_t& changed, ProgressTracker& progress)
+{
+    VERIFY(pOrig != NULL && pChanged != NULL);
+    return labelSeriesChangeVectors(getPair(pOrig, pChanged), pMask, std::vector<decisionInterval_t>(1, changed),
+        progress);
+}
+
+bool labelSeriesChangeVectors(const std::vector<RasterElement*>& dates, RasterElement* pMask,
+    const std::vector<decisionInterval_t>& changed, ProgressTracker& progress)
+{
+    VERIFY(dates.size() >= 2 && pMask != NULL && changed.size() == dates.size() - 1);
+    std::vector<cvaTile_t> tiles = createTiles(dates);
+    for (std::vector<cvaTile_t>::iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
+    {
+        tile->pMask = pMask;
+        tile->pDecisions = &changed;
+    }
+    return processTiles(tiles, "Generating the change mask", progress);
+}
@@ -0,0 +1,83 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef CHANGEVECTORANALYSIS_H
+#define CHANGEVECTORANALYSIS_H
+
+#include "GmmEM.h"
+
+class MultivariateGmm;
+class ProgressTracker;
+class RasterElement;
+struct principalComponents_t;
+
+// Statistics of the magnitudes found by computeChangeVectors()
+struct changeStats_t
+{
+    double minValue;
+    double maxValue;
+    // Empty when EM runs on every pixel
+    Histogram histogram;
+};
+
+// Computes the magnitude of the change vector of every pixel of the two images. The rows are split in
+// tiles that are processed in parallel, each tile with its own accessors, and only the statistics are kept:
+// when histogramBins is 0 every magnitude is stored in X, otherwise they are only counted in stats.histogram.
+// When histogramBins is 0 and sampleSize is not, X only receives a uniform random sample of about sampleSize
+// magnitudes, stratified by tile. stats.minValue and stats.maxValue always cover every pixel with a finite
+// magnitude, the histogram skips the others.
+bool computeChangeVectors(RasterElement* pOrig, RasterElement* pChanged, unsigned int histogramBins,
+    unsigned int sampleSize, changeStats_t& stats, dataPoints_t& X, ProgressTracker& progress);
+
+// The same for a time series of images, for each pair of consecutive dates. Every image is read once.
+// The sample holds the same pixels for every pair.
+bool computeSeriesChangeVectors(const std::vector<RasterElement*>& dates, unsigned int histogramBins,
+    unsigned int sampleSize, std::vector<changeStats_t>& stats, std::vector<dataPoints_t>& X,
+    ProgressTracker& progress);
+
+// Computes the magnitudes again, tile by tile, and writes them to the one band INT1UBYTE pMask raster
+// through labelChanges(). Memory use does not depend on the size of the images.
+bool labelChangeVectors(RasterElement* pOrig, RasterElement* pChanged, RasterElement* pMask,
+    const decisionInterval_t& changed, ProgressTracker& progress);
+
+// The same for a time series of images. pMask has one band for each pair of consecutive dates.
+bool labelSeriesChangeVectors(const std::vector<RasterElement*>& dates, RasterElement* pMask,
+    const std::vector<decisionInterval_t>& changed, ProgressTracker& progress);
+
+// Stores the difference of every band of every pixel (changed - original) in features,
+// one row of band count values per pixel. When sampleSize is not 0 and smaller than the number of pixels,
+// features only receives the rows of a uniform random sample of about sampleSize pixels, stratified by tile.
+bool computeChangeFeatures(RasterElement* pOrig, RasterElement* pChanged, unsigned int sampleSize,
+    std::vector<double>& features, ProgressTracker& progress);
+
+// Computes the band differences again, tile by tile, projects them on pComponents when it is not NULL and
+// writes classLabels[c] to the one band INT1UBYTE pMask raster, c being the component of model the pixel
+// belongs to. detectChangeClasses() uses 255 for the unchanged class and 0 to K - 2 for the change classes,
+// the same encoding as labelChanges() for two classes.
+bool labelChangeClasses(RasterElement* pOrig, RasterElement* pChanged, RasterElement* pMask,
+    const MultivariateGmm& model, const principalComponents_t* pComponents,
+    const std::vector<unsigned char>& classLabels, ProgressTracker& progress);
+
+// Black (0) for the changed pixels and white (255) for the others. Only compares
+// and bit operations so the compiler can vectorize the loop.
+template<typename T>
+void labelChanges(const T* pValues, unsigned char* pMask, unsigned int count, const decisionInterval_t& changed)
+{
+    const T low = static_cast<T>(changed.low);
+    const T high = static_cast<T>(changed.high);
+    const unsigned char outside = changed.inside ? 0 : 1;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        const unsigned char inInterval = static_cast<unsigned char>((pValues[i] > low) & (pValues[i] < high));
+        // 1 - 1 = 0 when changed, 0 - 1 wraps to 255 otherwise
+        pMask[i] = static_cast<unsigned char>((inInterval ^ outside) - 1);
+    }
+}
+
+#endif
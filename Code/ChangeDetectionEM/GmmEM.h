@@ -32,7 +32,51 @@ public:
 typedef std::vector<double> dataPoints_t;
 typedef std::vector<GMM> estimates_t;
 
+// The values x for which first.weight*first.probabilityFunction(x) is larger than the same for second
+// are those in (low, high) when inside is true, and all the others when it is false.
+// low and high may be infinite.
+struct decisionInterval_t
+{
+    double low;
+    double high;
+    bool inside;
+};
+
+// Solves the equality of the two weighted densities, a quadratic in x, for at most two thresholds.
+decisionInterval_t getDecisionInterval(const GMM& first, const GMM& second);
+
+// Counts of data points in equally wide bins covering [start, start + bins*width).
+// The range does not need to be known in advance: whenever a point falls outside of it the
+// width is doubled and neighbouring bins are merged, so at least a quarter of the bins stay in use.
+class Histogram
+{
+public:
+    double start;
+    double width;
+    std::vector<double> counts;
+    // Number of NaN and infinite values passed to add(), they are not counted in any bin
+    size_t skipped;
+
+    Histogram(unsigned int bins = 0);
+    void add(double x);
+    // Adds the counts of another histogram, spreading each of its bins over the bins it overlaps
+    void merge(const Histogram& other);
+    double binCenter(unsigned int bin) const;
+    // Centers and counts of the bins holding at least one point
+    void getOccupiedBins(dataPoints_t& centers, dataPoints_t& binCounts) const;
+
+private:
+    void grow(double x);
+    unsigned int binIndex(double x) const;
+};
 
-estimates_t EM(const estimates_t& initial, const dataPoints_t& points, unsigned int maxIterations, Progress* progress = NULL);
+// Runs at most maxIterations iterations, stopping early when the log-likelihood improves by less than
+// tolerance times its previous value. The iterations run and the final log-likelihood are returned
+// through pIterations and pLogLikelihood when they are not NULL.
+estimates_t EM(const estimates_t& initial, const dataPoints_t& points, unsigned int maxIterations, Progress* progress = NULL,
+    double tolerance = 0.0, unsigned int* pIterations = NULL, double* pLogLikelihood = NULL);
+// Runs EM on the bin centers weighted by the bin counts, so each iteration costs O(bins) instead of O(points).
+estimates_t EM(const estimates_t& initial, const Histogram& histogram, unsigned int maxIterations, Progress* progress = NULL,
+    double tolerance = 0.0, unsigned int* pIterations = NULL, double* pLogLikelihood = NULL);
 
 #endif
\ No newline at end of file
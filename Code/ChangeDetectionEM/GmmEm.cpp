@@ -11,118 +11,429 @@
 #include "ProgressTracker.h"
 #include <cmath>
 #include <numeric>
-#include <functional>
 #include <algorithm>
+#include <limits>
 
-typedef std::vector<std::vector<double> > prob_matrix_t;
+#ifndef QT_NO_CONCURRENT
+#include <QtCore/QtConcurrentMap>
+#endif
+
+namespace
+{
+    // Points handled by one task of the E-step
+    const unsigned int CHUNK_SIZE = 65536;
+
+    // Sufficient statistics of one component: the sums of the responsibilities r,
+    // of r*d and of r*d*d where d is the distance of a point from the current mean.
+    struct sufficientStats_t
+    {
+        double s0;
+        double s1;
+        double s2;
+    };
+
+    // Constants of the weighted normal density norm*exp(-(x - mean)^2*scale)
+    struct density_t
+    {
+        double mean;
+        double scale;
+        double norm;
+    };
+
+    struct chunk_t
+    {
+        const double* pX;
+        // NULL when every point has a weight of 1
+        const double* pWeights;
+        unsigned int count;
+        const std::vector<density_t>* pDensities;
+        std::vector<sufficientStats_t> stats;
+        // Log-likelihood of the points under the current estimates
+        double logLikelihood;
+    };
+
+    // Fused E-step and accumulation for the M-step over one chunk of points.
+    // The responsibilities are only kept for the current point.
+    void accumulateChunk(chunk_t& chunk)
+    {
+        const std::vector<density_t>& densities = *chunk.pDensities;
+        const unsigned int classes = densities.size();
+        std::vector<double> prob(classes);
+        sufficientStats_t zero = {0.0, 0.0, 0.0};
+        chunk.stats.assign(classes, zero);
+        chunk.logLikelihood = 0.0;
+
+        for (unsigned int i = 0; i < chunk.count; ++i)
+        {
+            const double x = chunk.pX[i];
+            double total = 0.0;
+            for (unsigned int k = 0; k < classes; ++k)
+            {
+                const double d = x - densities[k].mean;
+                prob[k] = densities[k].norm*exp(-d*d*densities[k].scale);
+                total += prob[k];
+            }
+            // Points too far from every component for the densities to be represented carry no information
+            if (total <= 0.0)
+            {
+                continue;
+            }
+            const double weight = (chunk.pWeights == NULL ? 1.0 : chunk.pWeights[i]);
+            chunk.logLikelihood += weight*log(total);
+            const double factor = weight/total;
+            for (unsigned int k = 0; k < classes; ++k)
+            {
+                const double r = prob[k]*factor;
+                const double d = x - densities[k].mean;
+                sufficientStats_t& stats = chunk.stats[k];
+                stats.s0 += r;
+                stats.s1 += r*d;
+                stats.s2 += r*d*d;
+            }
+        }
+    }
+};
 
 double GMM::probabilityFunction(double x) const
 {
     return (1 / (sqrt(2*G_PI) * stdDev)) * (exp(-0.5*pow((x - mean) / stdDev, 2)));
 }
 
-struct getProb: public std::unary_function<double, double>
+decisionInterval_t getDecisionInterval(const GMM& first, const GMM& second)
 {
-    const GMM& g;
-    getProb(const GMM& _g): g(_g) {}
-    double operator()(double x) const
+    const double infinity = std::numeric_limits<double>::infinity();
+    decisionInterval_t interval;
+    interval.low = -infinity;
+    interval.high = infinity;
+    // A zero or NaN standard deviation makes the density NaN, which never compares larger
+    if (!(first.stdDev > 0.0) || !(second.stdDev > 0.0))
     {
-        return g.weight * g.probabilityFunction(x);
+        interval.inside = false;
+        return interval;
     }
-};
 
-// E-step
-void computeProbabilities(prob_matrix_t& prob, std::vector<double>& sums, 
-    const dataPoints_t& X, const estimates_t& estimate) 
-{
-    std::vector<double>& psums = prob.back();
-    std::fill(psums.begin(), psums.end(), 0);
-    prob_matrix_t::iterator probItr = prob.begin();
+    // log(first) - log(second) = a*x*x + b*x + c
+    const double firstVariance = first.stdDev*first.stdDev;
+    const double secondVariance = second.stdDev*second.stdDev;
+    const double a = 0.5/secondVariance - 0.5/firstVariance;
+    const double b = first.mean/firstVariance - second.mean/secondVariance;
+    const double c = log(first.weight/first.stdDev) - log(second.weight/second.stdDev) -
+        0.5*first.mean*first.mean/firstVariance + 0.5*second.mean*second.mean/secondVariance;
 
-    for(estimates_t::const_iterator estimateItr = estimate.begin(); estimateItr != estimate.end(); ++estimateItr, ++probItr)
+    if (a == 0.0)
     {
-        std::transform(X.begin(), X.end(), probItr->begin(), getProb(*estimateItr));
-        std::transform(probItr->begin(), probItr->end(), psums.begin(), psums.begin(), std::plus<double>());
+        // Equal variances, a single threshold
+        interval.inside = (b != 0.0 || c > 0.0);
+        if (b > 0.0)
+        {
+            interval.low = -c/b;
+        }
+        else if (b < 0.0)
+        {
+            interval.high = -c/b;
+        }
+        return interval;
     }
-    probItr = prob.begin();
-    for(unsigned int dist = 0; dist < estimate.size(); ++dist, ++probItr)
+
+    const double discriminant = b*b - 4.0*a*c;
+    // The first component wins between the roots when its variance is the larger one (a < 0)
+    interval.inside = (a < 0.0);
+    if (discriminant <= 0.0)
     {
-        std::transform(probItr->begin(), probItr->end(), psums.begin(), probItr->begin(), 
-            std::divides<double>());
-        sums[dist] = std::accumulate(probItr->begin(), probItr->end(), 0.0);
+        // No sign change, the first component wins everywhere or nowhere
+        interval.inside = (a > 0.0);
+        return interval;
     }
+    // Numerically stable roots
+    const double q = -0.5*(b + (b < 0.0 ? -sqrt(discriminant) : sqrt(discriminant)));
+    const double root1 = q/a;
+    const double root2 = (q != 0.0) ? c/q : -root1;
+    interval.low = std::min(root1, root2);
+    interval.high = std::max(root1, root2);
+    return interval;
 }
 
-void updateWeights(GMM& g, double sum, int numPts) 
+Histogram::Histogram(unsigned int bins) : start(0.0), width(0.0), counts(bins + bins%2, 0.0), skipped(0)
+{}
+
+void Histogram::add(double x)
 {
-    g.weight = sum / numPts;
+    if (counts.empty())
+    {
+        return;
+    }
+    // Skip NaN and infinities, no range of bins could hold an infinity
+    if (x != x || fabs(x) > std::numeric_limits<double>::max())
+    {
+        ++skipped;
+        return;
+    }
+    if (width == 0.0)
+    {
+        // The first point starts the range with bins far narrower than the data will need
+        start = x;
+        width = std::max(fabs(x), 1.0)*1e-9;
+    }
+    if (x < start || x >= start + counts.size()*width)
+    {
+        grow(x);
+    }
+    counts[binIndex(x)]++;
 }
 
-void updateMeans(GMM& g, double sum, const std::vector<double>& ps, const dataPoints_t& X) 
+unsigned int Histogram::binIndex(double x) const
 {
-    double mean = 0.0;
-    for (unsigned int i = 0; i < X.size(); i++)
+    double bin = floor((x - start)/width);
+    return static_cast<unsigned int>(std::max(0.0, std::min(bin, counts.size() - 1.0)));
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    if (counts.empty())
+    {
+        return;
+    }
+    skipped += other.skipped;
+    if (other.width == 0.0)
+    {
+        return;
+    }
+    if (width == 0.0 && other.counts.size() == counts.size())
+    {
+        const size_t totalSkipped = skipped;
+        *this = other;
+        skipped = totalSkipped;
+        return;
+    }
+
+    // Only the occupied bins of other need to fit in the range
+    unsigned int firstBin = 0;
+    while (firstBin < other.counts.size() && other.counts[firstBin] == 0)
+    {
+        ++firstBin;
+    }
+    if (firstBin == other.counts.size())
     {
-        mean += X[i]*ps[i];
+        return;
+    }
+    unsigned int lastBin = other.counts.size() - 1;
+    while (other.counts[lastBin] == 0)
+    {
+        --lastBin;
+    }
+    if (width == 0.0)
+    {
+        // Start on the grid of other
+        start = other.start + firstBin*other.width;
+        width = other.width;
+    }
+    grow(other.start + firstBin*other.width);
+    grow(other.start + (lastBin + 0.5)*other.width);
+
+    for (unsigned int bin = firstBin; bin <= lastBin; ++bin)
+    {
+        const double count = other.counts[bin];
+        if (count == 0)
+        {
+            continue;
+        }
+        const double low = other.start + bin*other.width;
+        const double high = low + other.width;
+        const unsigned int first = binIndex(low);
+        const unsigned int last = binIndex(high);
+        double overlap = 0.0;
+        for (unsigned int i = first; i <= last; ++i)
+        {
+            overlap += std::max(0.0, std::min(high, start + (i + 1)*width) - std::max(low, start + i*width));
+        }
+        if (overlap <= 0.0)
+        {
+            counts[first] += count;
+            continue;
+        }
+        for (unsigned int i = first; i <= last; ++i)
+        {
+            counts[i] += count*std::max(0.0, std::min(high, start + (i + 1)*width) - std::max(low, start + i*width))/overlap;
+        }
     }
-    mean = mean/sum;
-    g.mean = mean;
 }
 
-void updateStdDevs(GMM& g, double sum, const std::vector<double>& ps, const dataPoints_t& X,
-    const GMM& prev) 
+void Histogram::grow(double x)
 {
-    double stdDev = 0.0;
-    double mean = prev.mean;
-    for (unsigned int i = 0; i < X.size(); i++)
+    const unsigned int bins = counts.size();
+    const unsigned int half = bins/2;
+    while (x < start || x >= start + bins*width)
     {
-        stdDev += pow(X[i] - mean, 2)*ps[i];
+        if (x >= start)
+        {
+            // Extend upwards: merge pairs into the lower half
+            for (unsigned int bin = 0; bin < half; ++bin)
+            {
+                counts[bin] = counts[2*bin] + counts[2*bin + 1];
+            }
+            std::fill(counts.begin() + half, counts.end(), 0.0);
+        }
+        else
+        {
+            // Extend downwards: merge pairs into the upper half
+            for (unsigned int bin = bins - 1; bin >= half; --bin)
+            {
+                counts[bin] = counts[2*bin - bins] + counts[2*bin - bins + 1];
+            }
+            std::fill(counts.begin(), counts.begin() + half, 0.0);
+            start -= bins*width;
+        }
+        width *= 2;
     }
-    stdDev = sqrt(stdDev/sum);
+}
 
-    g.stdDev = stdDev;
+double Histogram::binCenter(unsigned int bin) const
+{
+    return start + (bin + 0.5)*width;
 }
 
-estimates_t EM(const estimates_t& initial, const dataPoints_t& X, unsigned int maxIterations, Progress *progress) 
+void Histogram::getOccupiedBins(dataPoints_t& centers, dataPoints_t& binCounts) const
 {
-    // This will be used for probabilites calculation at each step
-    prob_matrix_t prob;
-    // Number of classes
-    const unsigned int classes = initial.size();
-    // Sum of probabilites of all classes
-    std::vector<double> sums(classes, 0);
+    centers.clear();
+    binCounts.clear();
+    for (unsigned int bin = 0; bin < counts.size(); ++bin)
+    {
+        if (counts[bin] > 0)
+        {
+            centers.push_back(binCenter(bin));
+            binCounts.push_back(counts[bin]);
+        }
+    }
+}
 
-    for(unsigned int i = 0; i < classes + 1; ++i)
+namespace
+{
+    // Runs the E-step for the estimates over every chunk in parallel and returns the log-likelihood of the
+    // points under the estimates.
+    double expectation(const estimates_t& estimates, std::vector<density_t>& densities, std::vector<chunk_t>& chunks)
     {
-        prob.push_back(std::vector<double>());
-        std::vector<double>& ps = prob.back();
-        ps.resize(X.size());
+        for (unsigned int k = 0; k < estimates.size(); ++k)
+        {
+            const GMM& g = estimates[k];
+            densities[k].mean = g.mean;
+            densities[k].scale = 0.5/(g.stdDev*g.stdDev);
+            densities[k].norm = g.weight/(sqrt(2*G_PI)*g.stdDev);
+        }
+#ifndef QT_NO_CONCURRENT
+        QtConcurrent::blockingMap(chunks, accumulateChunk);
+#else
+        std::for_each(chunks.begin(), chunks.end(), accumulateChunk);
+#endif
+        double logLikelihood = 0.0;
+        for (std::vector<chunk_t>::const_iterator chunkItr = chunks.begin(); chunkItr != chunks.end(); ++chunkItr)
+        {
+            logLikelihood += chunkItr->logLikelihood;
+        }
+        return logLikelihood;
     }
-    // Estimates after each iteration
-    estimates_t next = initial;
 
-    for(unsigned int iteration = 1; iteration <= maxIterations; ++iteration)
+    // When weights is not empty point i counts as weights[i] points with the same value.
+    // Each iteration is a single pass over X, split in chunks that are processed in parallel.
+    // Iterations stop once the log-likelihood improves by less than tolerance relative to its previous value.
+    estimates_t weightedEM(const estimates_t& initial, const dataPoints_t& X, const dataPoints_t& weights,
+        unsigned int maxIterations, Progress *progress, double tolerance, unsigned int* pIterations,
+        double* pLogLikelihood) 
     {
-        if (progress != NULL)
+        // Number of classes
+        const unsigned int classes = initial.size();
+        // Number of points represented by X
+        const double numPts = weights.empty() ? X.size() : std::accumulate(weights.begin(), weights.end(), 0.0);
+        // Estimates after each iteration
+        estimates_t next = initial;
+        std::vector<density_t> densities(classes);
+
+        std::vector<chunk_t> chunks;
+        for (unsigned int start = 0; start < X.size(); start += CHUNK_SIZE)
         {
-            progress->updateProgress("EM running on difference image", 100*iteration/maxIterations, NORMAL);
+            chunk_t chunk;
+            chunk.pX = &X[start];
+            chunk.pWeights = weights.empty() ? NULL : &weights[start];
+            chunk.count = std::min(CHUNK_SIZE, static_cast<unsigned int>(X.size()) - start);
+            chunk.pDensities = &densities;
+            chunk.logLikelihood = 0.0;
+            chunks.push_back(chunk);
         }
-        std::fill(sums.begin(), sums.end(), 0.0);
-        computeProbabilities(prob, sums, X, next);
 
-        estimates_t::iterator estimateItr = next.begin();
-        estimates_t::const_iterator prev_estimateItr = next.begin();
-        std::vector<double>::const_iterator sumItr = sums.begin();
-        prob_matrix_t::const_iterator probItr = prob.begin();
+        double logLikelihood = 0.0;
+        unsigned int iteration = 1;
+        for(; iteration <= maxIterations; ++iteration)
+        {
+            if (progress != NULL)
+            {
+                progress->updateProgress("EM running on difference image", 100*iteration/maxIterations, NORMAL);
+            }
+            // E-step, the log-likelihood is the one of the estimates of the previous iteration
+            const double previousLogLikelihood = logLikelihood;
+            logLikelihood = expectation(next, densities, chunks);
 
-        // M-step
-        for(; estimateItr != next.end(); ++estimateItr, ++sumItr, ++probItr, ++prev_estimateItr)
+            // M-step
+            estimates_t updated = next;
+            bool collapsed = false;
+            for (unsigned int k = 0; k < classes && collapsed == false; ++k)
+            {
+                sufficientStats_t stats = {0.0, 0.0, 0.0};
+                for (std::vector<chunk_t>::const_iterator chunkItr = chunks.begin(); chunkItr != chunks.end();
+                    ++chunkItr)
+                {
+                    stats.s0 += chunkItr->stats[k].s0;
+                    stats.s1 += chunkItr->stats[k].s1;
+                    stats.s2 += chunkItr->stats[k].s2;
+                }
+                // A component without responsibility has no estimates, stop at those of the previous iteration
+                if (!(stats.s0 > 0.0))
+                {
+                    collapsed = true;
+                    break;
+                }
+                // The deviation is taken around the mean of the previous iteration
+                GMM& g = updated[k];
+                g.stdDev = sqrt(stats.s2/stats.s0);
+                g.mean += stats.s1/stats.s0;
+                g.weight = stats.s0/numPts;
+            }
+            if (collapsed)
+            {
+                break;
+            }
+            next.swap(updated);
+
+            // EM never decreases the likelihood, so a small or negative change means it has converged
+            if (iteration > 1 && logLikelihood - previousLogLikelihood <= tolerance*fabs(previousLogLikelihood))
+            {
+                break;
+            }
+        }
+        if (pIterations != NULL)
         {
-            updateStdDevs(*estimateItr, *sumItr, *probItr, X, *prev_estimateItr);
-            updateMeans(*estimateItr, *sumItr, *probItr, X);
-            updateWeights(*estimateItr, *sumItr, X.size());
+            *pIterations = std::min(iteration, maxIterations);
         }
+        // The log-likelihood of the returned estimates takes one more E-step past the last M-step
+        if (pLogLikelihood != NULL)
+        {
+            *pLogLikelihood = expectation(next, densities, chunks);
+        }
+        estimates_t final = next;
+        return final;
     }
-    estimates_t final = next;
-    return final;
+};
+
+estimates_t EM(const estimates_t& initial, const dataPoints_t& X, unsigned int maxIterations, Progress *progress,
+    double tolerance, unsigned int* pIterations, double* pLogLikelihood) 
+{
+    return weightedEM(initial, X, dataPoints_t(), maxIterations, progress, tolerance, pIterations, pLogLikelihood);
+}
+
+estimates_t EM(const estimates_t& initial, const Histogram& histogram, unsigned int maxIterations, Progress *progress,
+    double tolerance, unsigned int* pIterations, double* pLogLikelihood)
+{
+    // Only the occupied bins take part, empty bins carry no weight.
+    dataPoints_t centers;
+    dataPoints_t counts;
+    histogram.getOccupiedBins(centers, counts);
+    return weightedEM(initial, centers, counts, maxIterations, progress, tolerance, pIterations, pLogLikelihood);
 }
@@ -0,0 +1,515 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "MultivariateGmm.h"
+#include "GmmEM.h"
+#include "ProgressTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <utility>
+
+#ifndef QT_NO_CONCURRENT
+#include <QtCore/QtConcurrentMap>
+#endif
+
+namespace
+{
+    // Points handled by one task of the E-step
+    const unsigned int CHUNK_SIZE = 16384;
+    // Added to the diagonal of the covariances, relative to the mean variance, to keep them positive definite
+    const double RIDGE = 1e-9;
+
+    // Sums of the responsibilities r, of r*d and of r*d*d' where d is the distance of a point from the
+    // mean of the component used in the E-step. Only the lower triangle of the second moments is used.
+    struct chunk_t
+    {
+        const double* pFeatures;
+        unsigned int count;
+        const MultivariateGmm* pModel;
+        std::vector<double> s0;
+        std::vector<double> s1;
+        std::vector<double> s2;
+        double logLikelihood;
+    };
+
+    void accumulateChunk(chunk_t& chunk)
+    {
+        const MultivariateGmm& model = *chunk.pModel;
+        const unsigned int k = model.components;
+        const unsigned int d = model.dimensions;
+        chunk.s0.assign(k, 0.0);
+        chunk.s1.assign(k*d, 0.0);
+        chunk.s2.assign(k*d*d, 0.0);
+        chunk.logLikelihood = 0.0;
+        std::vector<double> logProb(k);
+        std::vector<double> work(d);
+        std::vector<double> distance(d);
+
+        for (unsigned int point = 0; point < chunk.count; ++point)
+        {
+            const double* pFeature = chunk.pFeatures + static_cast<size_t>(point)*d;
+            // Normalize in the log domain, the densities of distant points underflow in high dimensions
+            double maxLogProb = -std::numeric_limits<double>::max();
+            for (unsigned int c = 0; c < k; ++c)
+            {
+                logProb[c] = model.logProbability(c, pFeature, &work[0]);
+                maxLogProb = std::max(maxLogProb, logProb[c]);
+            }
+            double total = 0.0;
+            for (unsigned int c = 0; c < k; ++c)
+            {
+                logProb[c] = exp(logProb[c] - maxLogProb);
+                total += logProb[c];
+            }
+            chunk.logLikelihood += maxLogProb + log(total);
+
+            for (unsigned int c = 0; c < k; ++c)
+            {
+                const double r = logProb[c]/total;
+                if (r == 0.0)
+                {
+                    continue;
+                }
+                const double* pMean = &model.means[c*d];
+                double* pS1 = &chunk.s1[c*d];
+                double* pS2 = &chunk.s2[c*d*d];
+                chunk.s0[c] += r;
+                for (unsigned int i = 0; i < d; ++i)
+                {
+                    distance[i] = pFeature[i] - pMean[i];
+                    pS1[i] += r*distance[i];
+                }
+                for (unsigned int i = 0; i < d; ++i)
+                {
+                    const double rd = r*distance[i];
+                    const unsigned int last = model.diagonal ? i : 0;
+                    for (unsigned int j = last; j <= i; ++j)
+                    {
+                        pS2[i*d + j] += rd*distance[j];
+                    }
+                }
+            }
+        }
+    }
+
+    // Mean and covariance of all feature vectors
+    void getCovariance(const std::vector<double>& features, unsigned int d, std::vector<double>& mean,
+        std::vector<double>& covariance)
+    {
+        const size_t count = features.size()/d;
+        mean.assign(d, 0.0);
+        covariance.assign(d*d, 0.0);
+        for (size_t point = 0; point < count; ++point)
+        {
+            for (unsigned int i = 0; i < d; ++i)
+            {
+                mean[i] += features[point*d + i];
+            }
+        }
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            mean[i] /= count;
+        }
+        std::vector<double> distance(d);
+        for (size_t point = 0; point < count; ++point)
+        {
+            for (unsigned int i = 0; i < d; ++i)
+            {
+                distance[i] = features[point*d + i] - mean[i];
+            }
+            for (unsigned int i = 0; i < d; ++i)
+            {
+                for (unsigned int j = 0; j <= i; ++j)
+                {
+                    covariance[i*d + j] += distance[i]*distance[j];
+                }
+            }
+        }
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            for (unsigned int j = 0; j <= i; ++j)
+            {
+                covariance[i*d + j] /= count;
+                covariance[j*d + i] = covariance[i*d + j];
+            }
+        }
+    }
+
+    // Eigen decomposition of the symmetric n x n matrix a with cyclic Jacobi rotations.
+    // a is destroyed, the eigenvalues are returned in values and the eigenvectors in the columns of vectors.
+    void jacobiEigen(std::vector<double>& a, unsigned int n, std::vector<double>& values, std::vector<double>& vectors)
+    {
+        vectors.assign(n*n, 0.0);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            vectors[i*n + i] = 1.0;
+        }
+        for (unsigned int sweep = 0; sweep < 100; ++sweep)
+        {
+            double offDiagonal = 0.0;
+            double diagonal = 0.0;
+            for (unsigned int p = 0; p < n; ++p)
+            {
+                diagonal += a[p*n + p]*a[p*n + p];
+                for (unsigned int q = p + 1; q < n; ++q)
+                {
+                    offDiagonal += a[p*n + q]*a[p*n + q];
+                }
+            }
+            if (offDiagonal <= 1e-30*diagonal)
+            {
+                break;
+            }
+            for (unsigned int p = 0; p < n; ++p)
+            {
+                for (unsigned int q = p + 1; q < n; ++q)
+                {
+                    const double apq = a[p*n + q];
+                    if (apq == 0.0)
+                    {
+                        continue;
+                    }
+                    const double theta = (a[q*n + q] - a[p*n + p])/(2*apq);
+                    const double t = (theta >= 0 ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1));
+                    const double c = 1/sqrt(t*t + 1);
+                    const double s = t*c;
+                    for (unsigned int k = 0; k < n; ++k)
+                    {
+                        const double akp = a[k*n + p];
+                        const double akq = a[k*n + q];
+                        a[k*n + p] = c*akp - s*akq;
+                        a[k*n + q] = s*akp + c*akq;
+                    }
+                    for (unsigned int k = 0; k < n; ++k)
+                    {
+                        const double apk = a[p*n + k];
+                        const double aqk = a[q*n + k];
+                        a[p*n + k] = c*apk - s*aqk;
+                        a[q*n + k] = s*apk + c*aqk;
+                    }
+                    for (unsigned int k = 0; k < n; ++k)
+                    {
+                        const double vkp = vectors[k*n + p];
+                        const double vkq = vectors[k*n + q];
+                        vectors[k*n + p] = c*vkp - s*vkq;
+                        vectors[k*n + q] = s*vkp + c*vkq;
+                    }
+                }
+            }
+        }
+        values.resize(n);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            values[i] = a[i*n + i];
+        }
+    }
+};
+
+MultivariateGmm::MultivariateGmm(unsigned int _components, unsigned int _dimensions, bool _diagonal) :
+    components(_components),
+    dimensions(_dimensions),
+    diagonal(_diagonal),
+    weights(_components, 1.0/_components),
+    means(_components*_dimensions, 0.0),
+    covariances(_components*_dimensions*_dimensions, 0.0),
+    iterations(0),
+    logLikelihood(0.0)
+{}
+
+void MultivariateGmm::initialize(const std::vector<double>& features)
+{
+    const unsigned int d = dimensions;
+    const size_t count = features.size()/d;
+
+    // The initial means are the points at evenly spaced quantiles of the length of the feature vectors.
+    // With band differences the first component starts at the smallest changes, with principal components
+    // at the points closest to the mean difference.
+    std::vector<std::pair<double, size_t> > lengths(count);
+    for (size_t point = 0; point < count; ++point)
+    {
+        double length = 0.0;
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            length += features[point*d + i]*features[point*d + i];
+        }
+        lengths[point] = std::make_pair(length, point);
+    }
+    for (unsigned int c = 0; c < components; ++c)
+    {
+        std::vector<std::pair<double, size_t> >::iterator quantile = lengths.begin() +
+            static_cast<size_t>((c + 0.5)*count/components);
+        std::nth_element(lengths.begin(), quantile, lengths.end());
+        std::copy(&features[quantile->second*d], &features[quantile->second*d] + d, &means[c*d]);
+    }
+
+    // Every component starts with the covariance of all points
+    std::vector<double> mean;
+    std::vector<double> covariance;
+    getCovariance(features, d, mean, covariance);
+    for (unsigned int c = 0; c < components; ++c)
+    {
+        weights[c] = 1.0/components;
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            for (unsigned int j = 0; j < d; ++j)
+            {
+                covariances[(c*d + i)*d + j] = (diagonal && i != j) ? 0.0 : covariance[i*d + j];
+            }
+        }
+    }
+}
+
+bool MultivariateGmm::updateDensities()
+{
+    const unsigned int d = dimensions;
+    choleskyFactors.assign(covariances.size(), 0.0);
+    logNorms.resize(components);
+    for (unsigned int c = 0; c < components; ++c)
+    {
+        const double* pCovariance = &covariances[c*d*d];
+        double* pFactor = &choleskyFactors[c*d*d];
+        double trace = 0.0;
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            trace += pCovariance[i*d + i];
+        }
+        const double ridge = RIDGE*trace/d + std::numeric_limits<double>::min();
+
+        double logDet = 0.0;
+        for (unsigned int j = 0; j < d; ++j)
+        {
+            double sum = pCovariance[j*d + j] + ridge;
+            for (unsigned int m = 0; m < j; ++m)
+            {
+                sum -= pFactor[j*d + m]*pFactor[j*d + m];
+            }
+            if (sum <= 0.0)
+            {
+                return false;
+            }
+            pFactor[j*d + j] = sqrt(sum);
+            logDet += 2*log(pFactor[j*d + j]);
+            if (diagonal)
+            {
+                continue;
+            }
+            for (unsigned int i = j + 1; i < d; ++i)
+            {
+                double value = pCovariance[i*d + j];
+                for (unsigned int m = 0; m < j; ++m)
+                {
+                    value -= pFactor[i*d + m]*pFactor[j*d + m];
+                }
+                pFactor[i*d + j] = value/pFactor[j*d + j];
+            }
+        }
+        logNorms[c] = log(weights[c]) - 0.5*logDet - 0.5*d*log(2*G_PI);
+    }
+    return true;
+}
+
+double MultivariateGmm::logProbability(unsigned int component, const double* pFeature, double* pWork) const
+{
+    const unsigned int d = dimensions;
+    const double* pMean = &means[component*d];
+    const double* pFactor = &choleskyFactors[component*d*d];
+    // Solve L*y = x - mean, the Mahalanobis distance is |y|^2
+    double distance = 0.0;
+    for (unsigned int i = 0; i < d; ++i)
+    {
+        double value = pFeature[i] - pMean[i];
+        if (diagonal == false)
+        {
+            const double* pRow = pFactor + i*d;
+            for (unsigned int j = 0; j < i; ++j)
+            {
+                value -= pRow[j]*pWork[j];
+            }
+        }
+        pWork[i] = value/pFactor[i*d + i];
+        distance += pWork[i]*pWork[i];
+    }
+    return logNorms[component] - 0.5*distance;
+}
+
+unsigned int MultivariateGmm::classify(const double* pFeature, double* pWork) const
+{
+    unsigned int best = 0;
+    double bestLogProb = -std::numeric_limits<double>::max();
+    for (unsigned int c = 0; c < components; ++c)
+    {
+        const double logProb = logProbability(c, pFeature, pWork);
+        if (logProb > bestLogProb)
+        {
+            bestLogProb = logProb;
+            best = c;
+        }
+    }
+    return best;
+}
+
+bool MultivariateGmm::fit(const std::vector<double>& features, unsigned int maxIterations, double tolerance,
+    Progress* progress)
+{
+    const unsigned int d = dimensions;
+    const size_t count = features.size()/d;
+    if (components == 0 || count < components)
+    {
+        return false;
+    }
+    initialize(features);
+
+    std::vector<chunk_t> chunks;
+    for (size_t start = 0; start < count; start += CHUNK_SIZE)
+    {
+        chunk_t chunk;
+        chunk.pFeatures = &features[start*d];
+        chunk.count = static_cast<unsigned int>(std::min<size_t>(CHUNK_SIZE, count - start));
+        chunk.pModel = this;
+        chunk.logLikelihood = 0.0;
+        chunks.push_back(chunk);
+    }
+
+    logLikelihood = 0.0;
+    for (iterations = 1; iterations <= maxIterations; ++iterations)
+    {
+        if (progress != NULL)
+        {
+            progress->updateProgress("EM running on change features", 100*iterations/maxIterations, NORMAL);
+        }
+        if (updateDensities() == false)
+        {
+            return false;
+        }
+
+        // E-step
+#ifndef QT_NO_CONCURRENT
+        QtConcurrent::blockingMap(chunks, accumulateChunk);
+#else
+        std::for_each(chunks.begin(), chunks.end(), accumulateChunk);
+#endif
+        const double previousLogLikelihood = logLikelihood;
+        logLikelihood = 0.0;
+        std::vector<double> s0(components, 0.0);
+        std::vector<double> s1(components*d, 0.0);
+        std::vector<double> s2(components*d*d, 0.0);
+        for (std::vector<chunk_t>::const_iterator chunk = chunks.begin(); chunk != chunks.end(); ++chunk)
+        {
+            logLikelihood += chunk->logLikelihood;
+            std::transform(s0.begin(), s0.end(), chunk->s0.begin(), s0.begin(), std::plus<double>());
+            std::transform(s1.begin(), s1.end(), chunk->s1.begin(), s1.begin(), std::plus<double>());
+            std::transform(s2.begin(), s2.end(), chunk->s2.begin(), s2.begin(), std::plus<double>());
+        }
+
+        // M-step
+        for (unsigned int c = 0; c < components; ++c)
+        {
+            weights[c] = s0[c]/count;
+            // A component without enough points to estimate a covariance keeps its previous shape
+            if (s0[c] <= d)
+            {
+                continue;
+            }
+            double* pMean = &means[c*d];
+            double* pCovariance = &covariances[c*d*d];
+            const double* pS1 = &s1[c*d];
+            const double* pS2 = &s2[c*d*d];
+            for (unsigned int i = 0; i < d; ++i)
+            {
+                for (unsigned int j = 0; j <= i; ++j)
+                {
+                    double value = 0.0;
+                    if (diagonal == false || i == j)
+                    {
+                        value = pS2[i*d + j]/s0[c] - (pS1[i]/s0[c])*(pS1[j]/s0[c]);
+                    }
+                    pCovariance[i*d + j] = value;
+                    pCovariance[j*d + i] = value;
+                }
+            }
+            for (unsigned int i = 0; i < d; ++i)
+            {
+                pMean[i] += pS1[i]/s0[c];
+            }
+        }
+
+        if (iterations > 1 && logLikelihood - previousLogLikelihood <= tolerance*fabs(previousLogLikelihood))
+        {
+            break;
+        }
+    }
+    iterations = std::min(iterations, maxIterations);
+    return updateDensities();
+}
+
+void findPrincipalComponents(const std::vector<double>& features, unsigned int dimensions, unsigned int count,
+    principalComponents_t& components)
+{
+    const unsigned int d = dimensions;
+    components.dimensions = d;
+    components.count = std::min(count, d);
+    std::vector<double> covariance;
+    getCovariance(features, d, components.mean, covariance);
+    std::vector<double> values;
+    std::vector<double> vectors;
+    jacobiEigen(covariance, d, values, vectors);
+
+    // Order the components by decreasing variance
+    std::vector<std::pair<double, unsigned int> > order(d);
+    for (unsigned int i = 0; i < d; ++i)
+    {
+        order[i] = std::make_pair(values[i], i);
+    }
+    std::sort(order.begin(), order.end(), std::greater<std::pair<double, unsigned int> >());
+    components.axes.resize(components.count*d);
+    for (unsigned int component = 0; component < components.count; ++component)
+    {
+        const unsigned int column = order[component].second;
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            components.axes[component*d + i] = vectors[i*d + column];
+        }
+    }
+}
+
+void projectFeature(const principalComponents_t& components, const double* pFeature, double* pWork,
+    double* pProjection)
+{
+    const unsigned int d = components.dimensions;
+    for (unsigned int i = 0; i < d; ++i)
+    {
+        pWork[i] = pFeature[i] - components.mean[i];
+    }
+    const double* pAxis = &components.axes[0];
+    for (unsigned int component = 0; component < components.count; ++component, pAxis += d)
+    {
+        double value = 0.0;
+        for (unsigned int i = 0; i < d; ++i)
+        {
+            value += pWork[i]*pAxis[i];
+        }
+        pProjection[component] = value;
+    }
+}
+
+void projectPrincipalComponents(const principalComponents_t& components, std::vector<double>& features)
+{
+    const size_t points = features.size()/components.dimensions;
+    // Rows only move towards the start, so the projection can be done in place
+    std::vector<double> work(components.dimensions);
+    for (size_t point = 0; point < points; ++point)
+    {
+        projectFeature(components, &features[point*components.dimensions], &work[0],
+            &features[point*components.count]);
+    }
+    features.resize(points*components.count);
+}
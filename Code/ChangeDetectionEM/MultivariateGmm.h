@@ -0,0 +1,78 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef MULTIVARIATEGMM_H
+#define MULTIVARIATEGMM_H
+
+#include <vector>
+#include "ProgressTracker.h"
+
+// Gaussian mixture of k components over d dimensional feature vectors.
+// Feature vectors are stored row major, one row of d values per point.
+class MultivariateGmm
+{
+public:
+    unsigned int components;
+    unsigned int dimensions;
+    // Only the variances of each dimension are estimated
+    bool diagonal;
+    // components values
+    std::vector<double> weights;
+    // components x dimensions values
+    std::vector<double> means;
+    // components x dimensions x dimensions values
+    std::vector<double> covariances;
+    // Iterations run and log-likelihood reached by fit()
+    unsigned int iterations;
+    double logLikelihood;
+
+    MultivariateGmm(unsigned int _components, unsigned int _dimensions, bool _diagonal);
+
+    // Fits the mixture with EM starting from means spread over the feature vectors ordered by length.
+    // Stops after maxIterations or when the log-likelihood improves by less than tolerance relative to its previous value.
+    bool fit(const std::vector<double>& features, unsigned int maxIterations, double tolerance, Progress* progress = NULL);
+    // The component with the highest posterior probability for the feature vector.
+    // pWork is scratch space for dimensions values.
+    unsigned int classify(const double* pFeature, double* pWork) const;
+    // log(weight*density) of the feature vector for the component, with the same scratch space as classify()
+    double logProbability(unsigned int component, const double* pFeature, double* pWork) const;
+
+private:
+    // Lower triangular Cholesky factors of the covariances, same layout as covariances
+    std::vector<double> choleskyFactors;
+    // log(weight) - log(det(covariance))/2 - dimensions*log(2*pi)/2 of each component
+    std::vector<double> logNorms;
+
+    void initialize(const std::vector<double>& features);
+    bool updateDensities();
+};
+
+// Mean and first principal axes of a set of feature vectors
+struct principalComponents_t
+{
+    unsigned int dimensions;
+    unsigned int count;
+    // dimensions values
+    std::vector<double> mean;
+    // count x dimensions values, one axis per row by decreasing variance
+    std::vector<double> axes;
+};
+
+// Finds the mean and the first count principal axes of the rows of dimensions values in features.
+void findPrincipalComponents(const std::vector<double>& features, unsigned int dimensions, unsigned int count,
+    principalComponents_t& components);
+// Projects one feature vector of components.dimensions values on the axes, writing components.count values
+// to pProjection. pWork is scratch space for components.dimensions values, pProjection may be pFeature.
+void projectFeature(const principalComponents_t& components, const double* pFeature, double* pWork,
+    double* pProjection);
+// Replaces the rows of components.dimensions values in features by their projections, leaving
+// components.count values per row.
+void projectPrincipalComponents(const principalComponents_t& components, std::vector<double>& features);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "CentroidDistances.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+namespace
+{
+	// Relative margin of the bounds for the rounding of the distances
+	const double BOUND_MARGIN = 1e-9;
+
+	size_t pairIndex(unsigned int a, unsigned int b)
+	{
+		if (a > b)
+		{
+			std::swap(a, b);
+		}
+		return static_cast<size_t>(b)*(b - 1)/2 + a;
+	}
+
+	double euclideanDistance(const double* pA, const double* pB, unsigned int bands)
+	{
+		double distance = 0.0;
+		for (unsigned int band = 0; band < bands; ++band)
+		{
+			distance += (pA[band] - pB[band])*(pA[band] - pB[band]);
+		}
+		return sqrt(distance);
+	}
+
+	// Index of the old centroid each new centroid took over the pixels of, -1 when it took over the
+	// pixels of none or of several
+	std::vector<int> getPredecessors(const std::vector<int>& successors, unsigned int newCount)
+	{
+		std::vector<int> predecessors(newCount, -1);
+		std::vector<unsigned int> takenOver(newCount, 0);
+		for (std::vector<int>::size_type i = 0; i < successors.size(); ++i)
+		{
+			if (successors[i] >= 0)
+			{
+				predecessors[successors[i]] = i;
+				++takenOver[successors[i]];
+			}
+		}
+		for (unsigned int c = 0; c < newCount; ++c)
+		{
+			if (takenOver[c] > 1)
+			{
+				predecessors[c] = -1;
+			}
+		}
+		return predecessors;
+	}
+};
+
+void moveCentroidDistances(centroidDistances_t& distances, const std::vector<double>& oldCentroids,
+	const std::vector<double>& newCentroids, const std::vector<int>& successors, unsigned int bands)
+{
+	if (bands == 0)
+	{
+		return;
+	}
+	const unsigned int oldCount = oldCentroids.size()/bands;
+	const unsigned int newCount = newCentroids.size()/bands;
+	// Every distance is unknown when they were not kept for the old centroids
+	const std::vector<int> predecessors = (distances.moved.size() == oldCount && successors.size() == oldCount) ?
+		getPredecessors(successors, newCount) : std::vector<int>(newCount, -1);
+
+	centroidDistances_t moved;
+	moved.moved.assign(newCount, 0.0);
+	moved.distances.assign(static_cast<size_t>(newCount)*(newCount - 1)/2, -1.0);
+	moved.movedAtDistance.assign(moved.distances.size(), 0.0);
+	for (unsigned int c = 0; c < newCount; ++c)
+	{
+		const int predecessor = predecessors[c];
+		if (predecessor >= 0)
+		{
+			moved.moved[c] = distances.moved[predecessor] + euclideanDistance(&oldCentroids[predecessor*bands],
+				&newCentroids[c*bands], bands);
+		}
+	}
+	for (unsigned int b = 1; b < newCount; ++b)
+	{
+		if (predecessors[b] < 0)
+		{
+			continue;
+		}
+		for (unsigned int a = 0; a < b; ++a)
+		{
+			if (predecessors[a] >= 0)
+			{
+				const size_t oldPair = pairIndex(predecessors[a], predecessors[b]);
+				moved.distances[pairIndex(a, b)] = distances.distances[oldPair];
+				moved.movedAtDistance[pairIndex(a, b)] = distances.movedAtDistance[oldPair];
+			}
+		}
+	}
+	distances.distances.swap(moved.distances);
+	distances.movedAtDistance.swap(moved.movedAtDistance);
+	distances.moved.swap(moved.moved);
+}
+
+void findLumpPairs(centroidDistances_t& distances, const std::vector<double>& oldCentroids,
+	const std::vector<double>& newCentroids, const std::vector<int>& successors, unsigned int bands,
+	double lump, unsigned int maxPairs, std::vector<lumpPair_t>& pairs)
+{
+	pairs.clear();
+	if (bands == 0 || maxPairs == 0)
+	{
+		return;
+	}
+	const unsigned int oldCount = oldCentroids.size()/bands;
+	const unsigned int newCount = newCentroids.size()/bands;
+	const bool known = (distances.moved.size() == oldCount && successors.size() == oldCount);
+	const std::vector<int> predecessors = known ? getPredecessors(successors, newCount) :
+		std::vector<int>(newCount, -1);
+
+	// Distance every centroid moved in the update
+	std::vector<double> shifts(newCount, 0.0);
+	for (unsigned int c = 0; c < newCount; ++c)
+	{
+		if (predecessors[c] >= 0)
+		{
+			shifts[c] = euclideanDistance(&oldCentroids[predecessors[c]*bands], &newCentroids[c*bands], bands);
+		}
+	}
+
+	// The closest pairs found so far, the farthest on top. Once there are maxPairs of them, a pair has to
+	// be closer than the top one.
+	std::priority_queue<lumpPair_t> closest;
+	for (unsigned int b = 1; b < newCount; ++b)
+	{
+		for (unsigned int a = 0; a < b; ++a)
+		{
+			const double threshold = (closest.size() < maxPairs) ? lump : std::min(lump, closest.top().dist);
+			const int oldA = predecessors[a];
+			const int oldB = predecessors[b];
+			size_t oldPair = 0;
+			if (oldA >= 0 && oldB >= 0)
+			{
+				// The distance kept for the old centroids is off by at most the distances they moved since
+				// it was computed, and the distances they moved in the update.
+				oldPair = pairIndex(oldA, oldB);
+				const double kept = distances.distances[oldPair];
+				const double slack = distances.moved[oldA] + distances.moved[oldB] -
+					distances.movedAtDistance[oldPair] + shifts[a] + shifts[b];
+				if (kept >= 0.0 && kept - slack > threshold + BOUND_MARGIN*kept)
+				{
+					continue;
+				}
+			}
+
+			const double distance = euclideanDistance(&newCentroids[a*bands], &newCentroids[b*bands], bands);
+			if (oldA >= 0 && oldB >= 0)
+			{
+				// Kept for the old centroids but measured at the updated ones, which moveCentroidDistances()
+				// will have moved by the shifts of the update.
+				distances.distances[oldPair] = distance;
+				distances.movedAtDistance[oldPair] = distances.moved[oldA] + distances.moved[oldB] +
+					shifts[a] + shifts[b];
+			}
+			if (distance >= lump)
+			{
+				continue;
+			}
+			const lumpPair_t pair(distance, a, b);
+			if (closest.size() < maxPairs)
+			{
+				closest.push(pair);
+			}
+			else if (pair < closest.top())
+			{
+				closest.pop();
+				closest.push(pair);
+			}
+		}
+	}
+
+	for (; closest.empty() == false; closest.pop())
+	{
+		pairs.push_back(closest.top());
+	}
+	std::reverse(pairs.begin(), pairs.end());
+}
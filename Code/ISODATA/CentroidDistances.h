@@ -0,0 +1,95 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef CENTROIDDISTANCES_H
+#define CENTROIDDISTANCES_H
+
+#include <vector>
+
+// Euclidean distances between the centroids, kept from one lump step to the next. A distance is only
+// recomputed when the centroids moved enough since it was computed that it could be below the lump
+// distance, and for centroids that were split or merged.
+struct centroidDistances_t
+{
+	// Distance between centroids a < b at b*(b - 1)/2 + a, negative when it was never computed
+	std::vector<double> distances;
+	// Sum of the distances the two centroids had moved when their distance was computed
+	std::vector<double> movedAtDistance;
+	// Distance every centroid moved since it was added
+	std::vector<double> moved;
+};
+
+// Pair of centroids whose distance is below the lump distance
+struct lumpPair_t
+{
+	lumpPair_t(double _dist, unsigned int _a, unsigned int _b) : dist(_dist), a(_a), b(_b)
+	{}
+
+	// Orders the pairs by distance, and by centroid for equal distances
+	bool operator<(const lumpPair_t& other) const
+	{
+		if (dist != other.dist)
+		{
+			return dist < other.dist;
+		}
+		return (a != other.a) ? (a < other.a) : (b < other.b);
+	}
+
+	double dist;
+	unsigned int a, b;
+};
+
+/**
+* Carries the distances over to a new set of centroids. The distances of a centroid that took over
+* the pixels of more than one old centroid, or of none, are unknown.
+*
+* @param distances
+*        The distances between the old centroids.
+* @param oldCentroids
+*        The old centroids, one row of band count values per centroid.
+* @param newCentroids
+*        The new centroids, one row of band count values per centroid.
+* @param successors
+*        Index in newCentroids of the centroid that took over the pixels of each old centroid,
+*        -1 for removed centroids.
+* @param bands
+*        The number of values of a centroid.
+*
+*/
+void moveCentroidDistances(centroidDistances_t& distances, const std::vector<double>& oldCentroids,
+	const std::vector<double>& newCentroids, const std::vector<int>& successors, unsigned int bands);
+
+/**
+* Finds the closest pairs of centroids below the lump distance, after the centroids the distances are
+* kept for were updated.
+*
+* @param distances
+*        The distances between the old centroids. The distances computed for the pairs are kept.
+* @param oldCentroids
+*        The centroids the distances are kept for, one row of band count values per centroid.
+* @param newCentroids
+*        The updated centroids, one row of band count values per centroid.
+* @param successors
+*        Index in newCentroids of the update of each old centroid, -1 for removed centroids. Every
+*        updated centroid is the update of one old centroid.
+* @param bands
+*        The number of values of a centroid.
+* @param lump
+*        Only pairs of updated centroids closer than this are found.
+* @param maxPairs
+*        The largest number of pairs found.
+* @param pairs
+*        Receives the pairs of updated centroids, closest first.
+*
+*/
+void findLumpPairs(centroidDistances_t& distances, const std::vector<double>& oldCentroids,
+	const std::vector<double>& newCentroids, const std::vector<int>& successors, unsigned int bands,
+	double lump, unsigned int maxPairs, std::vector<lumpPair_t>& pairs);
+
+#endif
@@ -0,0 +1,326 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "CentroidSeeding.h"
+#include "DistanceKernels.h"
+#include "RandomGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	// Number of power iterations used to find the principal axis of a part
+	const unsigned int POWER_ITERATIONS = 20;
+
+	// Pixels of the sample that can be chosen, copied together as they are compared with the centroids
+	struct candidates_t
+	{
+		unsigned int count;
+		unsigned int bands;
+		// Index of each candidate in the sample
+		std::vector<unsigned int> indices;
+		// The candidates, normalized for the spectral angle
+		std::vector<float> values;
+	};
+
+	// Zero pixels have no spectral angle to any centroid, they are not candidates with the spectral angle.
+	void getCandidates(const std::vector<float>& samples, unsigned int bands, DistanceMeasure measure,
+		candidates_t& candidates)
+	{
+		const unsigned int pixelCount = samples.size()/bands;
+		std::vector<float> pixels(samples);
+		std::vector<float> norms(pixelCount, 1.0f);
+		if (measure == SPECTRAL_ANGLE && pixelCount > 0)
+		{
+			normalizePixels(&pixels[0], pixelCount, bands, &norms[0]);
+		}
+		candidates.bands = bands;
+		for (unsigned int pixel = 0; pixel < pixelCount; ++pixel)
+		{
+			if (norms[pixel] > 0.0f)
+			{
+				candidates.indices.push_back(pixel);
+				candidates.values.insert(candidates.values.end(), pixels.begin() + pixel*bands,
+					pixels.begin() + (pixel + 1)*bands);
+			}
+		}
+		candidates.count = candidates.indices.size();
+	}
+
+	// Adds a pixel of the sample to the centroids
+	void addPixel(const std::vector<float>& samples, unsigned int bands, unsigned int pixel,
+		std::vector<double>& centroids)
+	{
+		centroids.insert(centroids.end(), samples.begin() + pixel*bands, samples.begin() + (pixel + 1)*bands);
+	}
+
+	void randomPixels(const std::vector<float>& samples, candidates_t& candidates, unsigned int count,
+		RandomGenerator& random, std::vector<double>& centroids)
+	{
+		random.shuffle(candidates.indices);
+		for (unsigned int i = 0; i < std::min(count, candidates.count); ++i)
+		{
+			addPixel(samples, candidates.bands, candidates.indices[i], centroids);
+		}
+	}
+
+	void kMeansPlusPlus(const std::vector<float>& samples, const candidates_t& candidates, unsigned int count,
+		RandomGenerator& random, std::vector<double>& centroids)
+	{
+		if (candidates.count == 0)
+		{
+			return;
+		}
+		const unsigned int bands = candidates.bands;
+		// Squared distance from every candidate to its nearest centroid
+		std::vector<float> nearest(candidates.count, std::numeric_limits<float>::max());
+		std::vector<float> distances(candidates.count);
+		centroidBlock_t block;
+		unsigned int chosen = random.nextIndex(candidates.count);
+		for (unsigned int c = 0; c < count; ++c)
+		{
+			addPixel(samples, bands, candidates.indices[chosen], centroids);
+			if (c + 1 == count)
+			{
+				break;
+			}
+
+			const std::vector<double> centroid(candidates.values.begin() + chosen*bands,
+				candidates.values.begin() + (chosen + 1)*bands);
+			setCentroidBlock(&centroid[0], 1, bands, false, block);
+			squaredDistances(&candidates.values[0], candidates.count, block, &distances[0]);
+			double total = 0.0;
+			for (unsigned int i = 0; i < candidates.count; ++i)
+			{
+				nearest[i] = std::min(nearest[i], distances[i]);
+				total += nearest[i];
+			}
+			// Every candidate is already a centroid
+			if (total <= 0.0)
+			{
+				break;
+			}
+
+			// The next centroid is drawn with a probability proportional to the squared distance
+			double target = random.nextDouble()*total;
+			chosen = 0;
+			while (chosen + 1 < candidates.count && (target >= nearest[chosen] || nearest[chosen] == 0.0f))
+			{
+				target -= nearest[chosen];
+				++chosen;
+			}
+			// Rounding can leave the target past the last candidate that is not a centroid yet
+			while (chosen > 0 && nearest[chosen] == 0.0f)
+			{
+				--chosen;
+			}
+		}
+	}
+
+	// Candidates of a part of the sample and their spread around their mean
+	struct part_t
+	{
+		std::vector<unsigned int> members;
+		std::vector<double> mean;
+		// Sum of the squared distances from the members to the mean, 0 when the part cannot be split
+		double spread;
+	};
+
+	void describePart(const candidates_t& candidates, part_t& part)
+	{
+		const unsigned int bands = candidates.bands;
+		part.mean.assign(bands, 0.0);
+		part.spread = 0.0;
+		if (part.members.empty())
+		{
+			return;
+		}
+		for (std::vector<unsigned int>::const_iterator member = part.members.begin(); member != part.members.end();
+			++member)
+		{
+			const float* pValues = &candidates.values[*member*bands];
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				part.mean[band] += pValues[band];
+			}
+		}
+		for (unsigned int band = 0; band < bands; ++band)
+		{
+			part.mean[band] /= part.members.size();
+		}
+		for (std::vector<unsigned int>::const_iterator member = part.members.begin(); member != part.members.end();
+			++member)
+		{
+			const float* pValues = &candidates.values[*member*bands];
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				part.spread += (pValues[band] - part.mean[band])*(pValues[band] - part.mean[band]);
+			}
+		}
+	}
+
+	// Direction of the largest variance of the part, by power iteration from a random direction
+	std::vector<double> principalAxis(const candidates_t& candidates, const part_t& part, RandomGenerator& random)
+	{
+		const unsigned int bands = candidates.bands;
+		std::vector<double> axis(bands);
+		for (unsigned int band = 0; band < bands; ++band)
+		{
+			axis[band] = random.nextDouble() - 0.5;
+		}
+		std::vector<double> offset(bands);
+		for (unsigned int iteration = 0; iteration < POWER_ITERATIONS; ++iteration)
+		{
+			std::vector<double> next(bands, 0.0);
+			for (std::vector<unsigned int>::const_iterator member = part.members.begin();
+				member != part.members.end(); ++member)
+			{
+				const float* pValues = &candidates.values[*member*bands];
+				double projection = 0.0;
+				for (unsigned int band = 0; band < bands; ++band)
+				{
+					offset[band] = pValues[band] - part.mean[band];
+					projection += offset[band]*axis[band];
+				}
+				for (unsigned int band = 0; band < bands; ++band)
+				{
+					next[band] += projection*offset[band];
+				}
+			}
+			double norm = 0.0;
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				norm += next[band]*next[band];
+			}
+			if (norm == 0.0)
+			{
+				break;
+			}
+			norm = sqrt(norm);
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				axis[band] = next[band]/norm;
+			}
+		}
+		return axis;
+	}
+
+	void principalAxisSplitting(const std::vector<float>& samples, const candidates_t& candidates,
+		unsigned int count, RandomGenerator& random, std::vector<double>& centroids)
+	{
+		if (candidates.count == 0)
+		{
+			return;
+		}
+		const unsigned int bands = candidates.bands;
+		std::vector<part_t> parts(1);
+		for (unsigned int i = 0; i < candidates.count; ++i)
+		{
+			parts[0].members.push_back(i);
+		}
+		describePart(candidates, parts[0]);
+
+		while (parts.size() < count)
+		{
+			unsigned int widest = 0;
+			for (unsigned int p = 1; p < parts.size(); ++p)
+			{
+				if (parts[p].spread > parts[widest].spread)
+				{
+					widest = p;
+				}
+			}
+			if (parts[widest].spread <= 0.0)
+			{
+				break;
+			}
+
+			// Split the part across its principal axis, through its mean
+			part_t& part = parts[widest];
+			const std::vector<double> axis = principalAxis(candidates, part, random);
+			part_t upper;
+			std::vector<unsigned int> lower;
+			for (std::vector<unsigned int>::const_iterator member = part.members.begin();
+				member != part.members.end(); ++member)
+			{
+				const float* pValues = &candidates.values[*member*bands];
+				double projection = 0.0;
+				for (unsigned int band = 0; band < bands; ++band)
+				{
+					projection += (pValues[band] - part.mean[band])*axis[band];
+				}
+				if (projection > 0.0)
+				{
+					upper.members.push_back(*member);
+				}
+				else
+				{
+					lower.push_back(*member);
+				}
+			}
+			if (upper.members.empty() || lower.empty())
+			{
+				part.spread = 0.0;
+				continue;
+			}
+			part.members.swap(lower);
+			describePart(candidates, part);
+			describePart(candidates, upper);
+			parts.push_back(upper);
+		}
+
+		// The centroids are the means of the pixels themselves, also when the parts were split on the
+		// normalized pixels
+		for (std::vector<part_t>::const_iterator part = parts.begin(); part != parts.end(); ++part)
+		{
+			std::vector<double> mean(bands, 0.0);
+			for (std::vector<unsigned int>::const_iterator member = part->members.begin();
+				member != part->members.end(); ++member)
+			{
+				const unsigned int pixel = candidates.indices[*member];
+				for (unsigned int band = 0; band < bands; ++band)
+				{
+					mean[band] += samples[pixel*bands + band];
+				}
+			}
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				centroids.push_back(mean[band]/part->members.size());
+			}
+		}
+	}
+};
+
+void seedCentroids(const std::vector<float>& samples, unsigned int bands, unsigned int count, SeedingMethod method,
+	DistanceMeasure measure, unsigned int seed, std::vector<double>& centroids)
+{
+	centroids.clear();
+	if (bands == 0 || count == 0)
+	{
+		return;
+	}
+	candidates_t candidates;
+	getCandidates(samples, bands, measure, candidates);
+	RandomGenerator random(seed);
+	switch (method)
+	{
+	case KMEANS_PLUS_PLUS:
+		kMeansPlusPlus(samples, candidates, count, random, centroids);
+		break;
+	case PRINCIPAL_AXIS_SPLITTING:
+		principalAxisSplitting(samples, candidates, count, random, centroids);
+		break;
+	default:
+		randomPixels(samples, candidates, count, random, centroids);
+		break;
+	}
+}
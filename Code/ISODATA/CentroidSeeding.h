@@ -0,0 +1,54 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef CENTROIDSEEDING_H
+#define CENTROIDSEEDING_H
+
+#include "ClusterAssignment.h"
+
+#include <vector>
+
+// How the initial centroids are chosen from a sample of pixels
+enum SeedingMethod
+{
+	// Uniformly random pixels
+	RANDOM_PIXELS,
+	// Pixels drawn with a probability proportional to their squared distance to the nearest centroid
+	// already drawn (k-means++)
+	KMEANS_PLUS_PLUS,
+	// Means of the parts obtained by repeatedly splitting the part with the largest sum of squared
+	// distances across its principal axis
+	PRINCIPAL_AXIS_SPLITTING
+};
+
+/**
+* Chooses the initial centroids from a sample of pixels.
+*
+* @param samples
+*        The pixels, one row of band count values per pixel.
+* @param bands
+*        The number of values of a pixel.
+* @param count
+*        The number of centroids.
+* @param method
+*        How the centroids are chosen.
+* @param measure
+*        The distances are spectral angles or euclidean distances. Zero pixels are not chosen with the
+*        spectral angle.
+* @param seed
+*        The same seed chooses the same centroids from the same sample.
+* @param centroids
+*        Receives the centroids, one row of band count values per centroid. There are fewer than count
+*        when the sample does not have enough distinct pixels.
+*
+*/
+void seedCentroids(const std::vector<float>& samples, unsigned int bands, unsigned int count, SeedingMethod method,
+	DistanceMeasure measure, unsigned int seed, std::vector<double>& centroids);
+
+#endif
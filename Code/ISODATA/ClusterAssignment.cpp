@@ -0,0 +1,684 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "AppVerify.h"
+#include "DataAccessor.h"
+#include "DataAccessorImpl.h"
+#include "DataRequest.h"
+#include "ObjectResource.h"
+#include "ProgressTracker.h"
+#include "RasterDataDescriptor.h"
+#include "RasterElement.h"
+#include "ClusterAssignment.h"
+#include "DistanceKernels.h"
+#include "RandomGenerator.h"
+
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#ifndef QT_NO_CONCURRENT
+#include <QtCore/QtConcurrentMap>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	// Approximate size of the part of the raster read by a tile
+	const unsigned int TILE_BYTES = 4*1024*1024;
+
+	// Number of pixels of the sample in a tile
+	const unsigned int SAMPLE_TILE = 4096;
+
+	const double PI = 3.14159265358979323846;
+
+	// The distances are computed in single precision and the bounds are stored as floats. Widening the bounds
+	// by this relative margin keeps them valid after rounding.
+	const double BOUND_MARGIN = 1e-4;
+
+	// The centroids and what is needed to compare pixels with them
+	struct centroidSet_t
+	{
+		const double* pValues;
+		unsigned int count;
+		unsigned int bands;
+		// The centroids as compared by the kernels, normalized for the spectral angle
+		centroidBlock_t block;
+		// Length of each centroid, only used for the spectral angle
+		std::vector<double> norms;
+		// Half the distance from each centroid to the nearest other centroid, only used with bounds
+		std::vector<double> halfSeparation;
+		DistanceMeasure measure;
+		double threshold;
+	};
+
+	struct assignTile_t
+	{
+		RasterElement* pRasterElement;
+		const centroidSet_t* pCentroids;
+		unsigned int startRow;
+		unsigned int rowCount;
+		// Label of the first pixel of the tile
+		int* pLabels;
+		// Bounds of the first pixel of the tile, NULL when every distance is computed
+		int* pNearest;
+		float* pUpper;
+		float* pLower;
+		// Pixels of a tile of a sample, NULL for a tile of the raster
+		const float* pSamples;
+		unsigned int sampleCount;
+		// Statistics of the pixels of the tile assigned to each centroid, only kept until they are merged
+		std::vector<clusterStats_t> stats;
+		bool success;
+	};
+
+	// Buffers of a tile, reused for every row
+	struct rowBuffers_t
+	{
+		// The pixels of the row converted to float, not used for a sample that is already in float
+		std::vector<float> pixels;
+		// The pixels of the row scaled to unit length, only used for the spectral angle
+		std::vector<float> units;
+		std::vector<float> norms;
+		// Columns of the pixels that are compared with all the centroids, and those pixels copied together
+		std::vector<unsigned int> pending;
+		std::vector<float> block;
+		std::vector<float> distances;
+	};
+
+	double infinity()
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+
+	float upperBound(double distance)
+	{
+		return static_cast<float>(distance*(1.0 + BOUND_MARGIN));
+	}
+
+	float lowerBound(double distance)
+	{
+		return static_cast<float>(std::max(0.0, distance*(1.0 - BOUND_MARGIN)));
+	}
+
+	// Angle in degrees from its cosine
+	double angle(double cosine)
+	{
+		return acos(std::max(-1.0, std::min(1.0, cosine)))*180.0/PI;
+	}
+
+	// Distance from a squared distance computed by the kernels. The pixels and the centroids are normalized
+	// for the spectral angle.
+	double kernelDistance(float squaredDistance, DistanceMeasure measure)
+	{
+		if (squaredDistance == std::numeric_limits<float>::infinity())
+		{
+			return infinity();
+		}
+		return (measure == SPECTRAL_ANGLE) ? unitAngle(squaredDistance) : sqrt(static_cast<double>(squaredDistance));
+	}
+
+	// Distance from the pixel, as compared by the kernels, to one centroid
+	double distanceTo(const float* pPixel, unsigned int c, const centroidSet_t& centroids)
+	{
+		if (centroids.measure == SPECTRAL_ANGLE && centroids.norms[c] == 0.0)
+		{
+			return infinity();
+		}
+		return kernelDistance(squaredDistance(pPixel, centroids.block, c), centroids.measure);
+	}
+
+	// Labels the pixel with its nearest centroid, unless it is beyond the threshold, and adds it to the
+	// statistics of the cluster
+	void labelPixel(const float* pPixel, size_t pixel, int nearest, double distance, assignTile_t& tile)
+	{
+		const centroidSet_t& centroids = *tile.pCentroids;
+		if (nearest != NO_MATCH && centroids.threshold > 0.0 && distance > centroids.threshold)
+		{
+			nearest = NO_MATCH;
+		}
+		tile.pLabels[pixel] = nearest;
+		if (nearest != NO_MATCH)
+		{
+			accumulateOffsets(pPixel, centroids.pValues + nearest*centroids.bands, centroids.bands,
+				tile.stats[nearest]);
+		}
+	}
+
+	/**
+	* Assigns the pixels of a row to their nearest centroids. The pixels whose bounds prove that their
+	* centroid is still the nearest one keep it, the others are compared with all the centroids at once.
+	*
+	* @param pPixels
+	*        The pixels of the row as floats.
+	* @param firstPixel
+	*        Index in the tile of the first pixel of the row.
+	*
+	*/
+	void assignRow(assignTile_t& tile, rowBuffers_t& buffers, const float* pPixels, size_t firstPixel,
+		unsigned int columns)
+	{
+		const centroidSet_t& centroids = *tile.pCentroids;
+		const unsigned int bands = centroids.bands;
+		const bool spectralAngle = (centroids.measure == SPECTRAL_ANGLE);
+
+		// The spectral angles are compared on the normalized pixels, the statistics on the pixels themselves
+		const float* pCompared = pPixels;
+		if (spectralAngle)
+		{
+			buffers.units.assign(pPixels, pPixels + columns*bands);
+			buffers.norms.resize(columns);
+			normalizePixels(&buffers.units[0], columns, bands, &buffers.norms[0]);
+			pCompared = &buffers.units[0];
+		}
+
+		buffers.pending.clear();
+		for (unsigned int col = 0; col < columns; ++col)
+		{
+			const size_t pixel = firstPixel + col;
+			// There is no spectral angle between a zero pixel and any centroid
+			if (spectralAngle && buffers.norms[col] == 0.0f)
+			{
+				tile.pLabels[pixel] = NO_MATCH;
+				continue;
+			}
+			const int nearest = (tile.pNearest != NULL) ? tile.pNearest[pixel] : -1;
+			if (nearest >= 0)
+			{
+				// The distance to the current centroid is needed anyway, so the upper bound is made exact first.
+				const double distance = distanceTo(pCompared + col*bands, nearest, centroids);
+				tile.pUpper[pixel] = upperBound(distance);
+				if (distance < infinity() &&
+					distance <= std::max<double>(tile.pLower[pixel], centroids.halfSeparation[nearest]))
+				{
+					labelPixel(pPixels + col*bands, pixel, nearest, distance, tile);
+					continue;
+				}
+			}
+			buffers.pending.push_back(col);
+		}
+		if (buffers.pending.empty())
+		{
+			return;
+		}
+
+		const unsigned int pendingCount = buffers.pending.size();
+		buffers.block.resize(pendingCount*bands);
+		for (unsigned int i = 0; i < pendingCount; ++i)
+		{
+			const float* pPixel = pCompared + buffers.pending[i]*bands;
+			std::copy(pPixel, pPixel + bands, buffers.block.begin() + i*bands);
+		}
+		buffers.distances.resize(pendingCount*centroids.count);
+		squaredDistances(&buffers.block[0], pendingCount, centroids.block, &buffers.distances[0]);
+
+		const float* pDistances = &buffers.distances[0];
+		for (unsigned int i = 0; i < pendingCount; ++i, pDistances += centroids.count)
+		{
+			int nearest = NO_MATCH;
+			float best = std::numeric_limits<float>::infinity();
+			float second = best;
+			for (unsigned int c = 0; c < centroids.count; ++c)
+			{
+				if (spectralAngle && centroids.norms[c] == 0.0)
+				{
+					continue;
+				}
+				if (pDistances[c] < best)
+				{
+					second = best;
+					best = pDistances[c];
+					nearest = c;
+				}
+				else if (pDistances[c] < second)
+				{
+					second = pDistances[c];
+				}
+			}
+			const unsigned int col = buffers.pending[i];
+			const size_t pixel = firstPixel + col;
+			const double distance = kernelDistance(best, centroids.measure);
+			if (tile.pNearest != NULL)
+			{
+				tile.pNearest[pixel] = nearest;
+				tile.pUpper[pixel] = upperBound(distance);
+				tile.pLower[pixel] = lowerBound(kernelDistance(second, centroids.measure));
+			}
+			labelPixel(pPixels + col*bands, pixel, nearest, distance, tile);
+		}
+	}
+
+	// The first argument only selects the data type, the data is read through the accessor row by row and
+	// converted to float once for all the kernels.
+	template<typename T>
+	void assignTile(T*, DataAccessor& accessor, unsigned int columns, assignTile_t& tile)
+	{
+		const unsigned int bands = tile.pCentroids->bands;
+		rowBuffers_t buffers;
+		buffers.pixels.resize(columns*bands);
+		for (unsigned int row = 0; row < tile.rowCount; ++row)
+		{
+			convertToFloat(reinterpret_cast<const T*>(accessor->getRow()), columns*bands, &buffers.pixels[0]);
+			assignRow(tile, buffers, &buffers.pixels[0], static_cast<size_t>(row)*columns, columns);
+			accessor->nextRow();
+		}
+	}
+
+	DataAccessor getTileAccessor(RasterElement* pRasterElement, unsigned int startRow, unsigned int rowCount)
+	{
+		const RasterDataDescriptor* pDescriptor =
+			static_cast<const RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
+		FactoryResource<DataRequest> pRequest;
+		pRequest->setInterleaveFormat(BIP);
+		pRequest->setRows(pDescriptor->getActiveRow(startRow), pDescriptor->getActiveRow(startRow + rowCount - 1), 1);
+		return pRasterElement->getDataAccessor(pRequest.release());
+	}
+
+	// Number of rows of the tiles the raster is processed in
+	unsigned int getTileRows(const RasterDataDescriptor* pDescriptor)
+	{
+		const unsigned int rowBytes =
+			pDescriptor->getColumnCount()*pDescriptor->getBandCount()*pDescriptor->getBytesPerElement();
+		return std::max(1u, TILE_BYTES/std::max(1u, rowBytes));
+	}
+
+	void processTile(assignTile_t& tile)
+	{
+		tile.success = false;
+		tile.stats.assign(tile.pCentroids->count, clusterStats_t(tile.pCentroids->bands));
+		if (tile.pSamples != NULL)
+		{
+			rowBuffers_t buffers;
+			assignRow(tile, buffers, tile.pSamples, 0, tile.sampleCount);
+			tile.success = true;
+			return;
+		}
+		DataAccessor accessor = getTileAccessor(tile.pRasterElement, tile.startRow, tile.rowCount);
+		if (accessor.isValid() == false)
+		{
+			return;
+		}
+		const RasterDataDescriptor* pDescriptor =
+			static_cast<const RasterDataDescriptor*>(tile.pRasterElement->getDataDescriptor());
+		switchOnEncoding(pDescriptor->getDataType(), assignTile, accessor->getRow(), accessor,
+			pDescriptor->getColumnCount(), tile);
+		tile.success = true;
+	}
+
+	// Adds the statistics of the tile to the statistics of the whole pass and frees them
+	void mergeStats(assignTile_t& tile, std::vector<clusterStats_t>& stats)
+	{
+		for (std::vector<clusterStats_t>::size_type c = 0; c < stats.size(); ++c)
+		{
+			stats[c].merge(tile.stats[c]);
+		}
+		std::vector<clusterStats_t>().swap(tile.stats);
+	}
+
+	// The tiles are handed to the thread pool a few at a time so the progress can be updated in between and
+	// only the statistics of those tiles are kept at the same time.
+	unsigned int getBatchSize()
+	{
+		return 4*std::max(1, QThread::idealThreadCount());
+	}
+
+	// Every tile has its own accessor and its own statistics, the threads share nothing they write to.
+	template<typename Iterator, typename Tile>
+	void processInParallel(Iterator begin, Iterator end, void (*pProcess)(Tile&))
+	{
+#ifndef QT_NO_CONCURRENT
+		QtConcurrent::blockingMap(begin, end, pProcess);
+#else
+		std::for_each(begin, end, pProcess);
+#endif
+	}
+
+	/**
+	* Sets up the centroids for the kernels.
+	*
+	* @param pBounds
+	*        The bounds of the accelerated assignment, NULL when every distance is computed. They are
+	*        initialized when they are not for pixelCount pixels.
+	*
+	*/
+	void setCentroids(const std::vector<double>& centroids, unsigned int bands, DistanceMeasure measure,
+		double threshold, assignmentBounds_t* pBounds, size_t pixelCount, centroidSet_t& centroidSet)
+	{
+		centroidSet.pValues = &centroids[0];
+		centroidSet.count = centroids.size()/bands;
+		centroidSet.bands = bands;
+		centroidSet.measure = measure;
+		centroidSet.threshold = threshold;
+		for (unsigned int c = 0; c < centroidSet.count; ++c)
+		{
+			double norm = 0.0;
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				norm += centroids[c*bands + band]*centroids[c*bands + band];
+			}
+			centroidSet.norms.push_back(sqrt(norm));
+		}
+		setCentroidBlock(&centroids[0], centroidSet.count, bands, measure == SPECTRAL_ANGLE, centroidSet.block);
+
+		if (pBounds != NULL)
+		{
+			centroidSet.halfSeparation.assign(centroidSet.count, infinity());
+			for (unsigned int a = 0; a < centroidSet.count; ++a)
+			{
+				for (unsigned int b = a + 1; b < centroidSet.count; ++b)
+				{
+					const double distance = 0.5*(1.0 - BOUND_MARGIN)*
+						centroidDistance(&centroids[a*bands], &centroids[b*bands], bands, measure);
+					centroidSet.halfSeparation[a] = std::min(centroidSet.halfSeparation[a], distance);
+					centroidSet.halfSeparation[b] = std::min(centroidSet.halfSeparation[b], distance);
+				}
+			}
+			if (pBounds->nearest.size() != pixelCount)
+			{
+				pBounds->nearest.assign(pixelCount, -1);
+				pBounds->upper.assign(pixelCount, 0.0f);
+				pBounds->lower.assign(pixelCount, 0.0f);
+			}
+		}
+	}
+
+	struct sampleTile_t
+	{
+		RasterElement* pRasterElement;
+		unsigned int startRow;
+		unsigned int rowCount;
+		// Number of pixels sampled from the tile, kept in values by reservoir sampling
+		unsigned int quota;
+		unsigned int pixelsSeen;
+		RandomGenerator random;
+		std::vector<float> values;
+		bool success;
+	};
+
+	// The first argument only selects the data type, the data is read through the accessor row by row.
+	template<typename T>
+	void sampleTile(T*, DataAccessor& accessor, unsigned int columns, sampleTile_t& tile)
+	{
+		const RasterDataDescriptor* pDescriptor =
+			static_cast<const RasterDataDescriptor*>(tile.pRasterElement->getDataDescriptor());
+		const unsigned int bands = pDescriptor->getBandCount();
+		std::vector<float> pixels(columns*bands);
+		for (unsigned int row = 0; row < tile.rowCount; ++row)
+		{
+			convertToFloat(reinterpret_cast<const T*>(accessor->getRow()), columns*bands, &pixels[0]);
+			for (unsigned int col = 0; col < columns; ++col, ++tile.pixelsSeen)
+			{
+				const unsigned int slot = (tile.pixelsSeen < tile.quota) ? tile.pixelsSeen :
+					tile.random.nextIndex(tile.pixelsSeen + 1);
+				if (slot < tile.quota)
+				{
+					std::copy(pixels.begin() + col*bands, pixels.begin() + (col + 1)*bands,
+						tile.values.begin() + slot*bands);
+				}
+			}
+			accessor->nextRow();
+		}
+	}
+
+	void processSampleTile(sampleTile_t& tile)
+	{
+		tile.success = false;
+		DataAccessor accessor = getTileAccessor(tile.pRasterElement, tile.startRow, tile.rowCount);
+		if (accessor.isValid() == false)
+		{
+			return;
+		}
+		const RasterDataDescriptor* pDescriptor =
+			static_cast<const RasterDataDescriptor*>(tile.pRasterElement->getDataDescriptor());
+		switchOnEncoding(pDescriptor->getDataType(), sampleTile, accessor->getRow(), accessor,
+			pDescriptor->getColumnCount(), tile);
+		tile.success = true;
+	}
+};
+
+bool assignPixels(RasterElement* pRasterElement, const std::vector<double>& centroids, DistanceMeasure measure,
+	double threshold, std::vector<int>& labels, std::vector<clusterStats_t>& stats, assignmentBounds_t* pBounds,
+	ProgressTracker& progress)
+{
+	VERIFY(pRasterElement != NULL);
+	const RasterDataDescriptor* pDescriptor =
+		static_cast<const RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
+	VERIFY(pDescriptor != NULL);
+	const unsigned int rowCount = pDescriptor->getRowCount();
+	const unsigned int colCount = pDescriptor->getColumnCount();
+	const unsigned int bands = pDescriptor->getBandCount();
+	VERIFY(bands > 0 && !centroids.empty() && centroids.size() % bands == 0);
+
+	const size_t pixelCount = static_cast<size_t>(rowCount)*colCount;
+	centroidSet_t centroidSet;
+	setCentroids(centroids, bands, measure, threshold, pBounds, pixelCount, centroidSet);
+
+	labels.resize(pixelCount);
+	const unsigned int tileRows = getTileRows(pDescriptor);
+	std::vector<assignTile_t> tiles;
+	for (unsigned int startRow = 0; startRow < rowCount; startRow += tileRows)
+	{
+		const size_t firstPixel = static_cast<size_t>(startRow)*colCount;
+		assignTile_t tile;
+		tile.pRasterElement = pRasterElement;
+		tile.pCentroids = &centroidSet;
+		tile.startRow = startRow;
+		tile.rowCount = std::min(tileRows, rowCount - startRow);
+		tile.pLabels = &labels[firstPixel];
+		tile.pNearest = (pBounds != NULL) ? &pBounds->nearest[firstPixel] : NULL;
+		tile.pUpper = (pBounds != NULL) ? &pBounds->upper[firstPixel] : NULL;
+		tile.pLower = (pBounds != NULL) ? &pBounds->lower[firstPixel] : NULL;
+		tile.pSamples = NULL;
+		tile.sampleCount = 0;
+		tile.success = false;
+		tiles.push_back(tile);
+	}
+
+	stats.assign(centroidSet.count, clusterStats_t(bands));
+	const unsigned int batchSize = getBatchSize();
+	for (unsigned int first = 0; first < tiles.size(); first += batchSize)
+	{
+		progress.report("Assigning pixels to the nearest centroids", 100*first/tiles.size(), NORMAL, true);
+		std::vector<assignTile_t>::iterator batchEnd = tiles.begin() + std::min<size_t>(first + batchSize, tiles.size());
+		processInParallel(tiles.begin() + first, batchEnd, processTile);
+
+		// The statistics are merged in the order of the tiles, so they do not depend on the number of threads.
+		for (std::vector<assignTile_t>::iterator tile = tiles.begin() + first; tile != batchEnd; ++tile)
+		{
+			if (tile->success == false)
+			{
+				progress.report(QString("Unable to access rows %1 to %2").arg(tile->startRow + 1)
+					.arg(tile->startRow + tile->rowCount).toStdString(), 0, ERRORS, true);
+				return false;
+			}
+			mergeStats(*tile, stats);
+		}
+	}
+	return true;
+}
+
+bool samplePixels(RasterElement* pRasterElement, unsigned int sampleSize, std::vector<float>& samples,
+	ProgressTracker& progress)
+{
+	VERIFY(pRasterElement != NULL);
+	const RasterDataDescriptor* pDescriptor =
+		static_cast<const RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
+	VERIFY(pDescriptor != NULL);
+	const unsigned int rowCount = pDescriptor->getRowCount();
+	const unsigned int colCount = pDescriptor->getColumnCount();
+	const unsigned int bands = pDescriptor->getBandCount();
+	const size_t pixelCount = static_cast<size_t>(rowCount)*colCount;
+	const unsigned int tileRows = getTileRows(pDescriptor);
+
+	std::vector<sampleTile_t> tiles;
+	for (unsigned int startRow = 0; startRow < rowCount; startRow += tileRows)
+	{
+		sampleTile_t tile;
+		tile.pRasterElement = pRasterElement;
+		tile.startRow = startRow;
+		tile.rowCount = std::min(tileRows, rowCount - startRow);
+		// Stratified by tile: every tile contributes in proportion to its pixels
+		const size_t tilePixels = static_cast<size_t>(tile.rowCount)*colCount;
+		tile.quota = static_cast<unsigned int>(std::min<double>(tilePixels,
+			ceil(static_cast<double>(sampleSize)*tilePixels/pixelCount)));
+		tile.pixelsSeen = 0;
+		tile.random.setSeed(startRow);
+		tile.values.resize(static_cast<size_t>(tile.quota)*bands);
+		tile.success = false;
+		tiles.push_back(tile);
+	}
+
+	samples.clear();
+	const unsigned int batchSize = getBatchSize();
+	for (unsigned int first = 0; first < tiles.size(); first += batchSize)
+	{
+		progress.report("Sampling pixels", 100*first/tiles.size(), NORMAL, true);
+		std::vector<sampleTile_t>::iterator batchEnd = tiles.begin() + std::min<size_t>(first + batchSize, tiles.size());
+		processInParallel(tiles.begin() + first, batchEnd, processSampleTile);
+		for (std::vector<sampleTile_t>::iterator tile = tiles.begin() + first; tile != batchEnd; ++tile)
+		{
+			if (tile->success == false)
+			{
+				progress.report(QString("Unable to access rows %1 to %2").arg(tile->startRow + 1)
+					.arg(tile->startRow + tile->rowCount).toStdString(), 0, ERRORS, true);
+				return false;
+			}
+			samples.insert(samples.end(), tile->values.begin(), tile->values.end());
+			std::vector<float>().swap(tile->values);
+		}
+	}
+	return true;
+}
+
+void assignSamples(const std::vector<float>& samples, unsigned int bands, const std::vector<double>& centroids,
+	DistanceMeasure measure, double threshold, std::vector<int>& labels, std::vector<clusterStats_t>& stats,
+	assignmentBounds_t* pBounds)
+{
+	VERIFYNRV(bands > 0 && !centroids.empty() && centroids.size() % bands == 0 && !samples.empty());
+	const size_t sampleCount = samples.size()/bands;
+	centroidSet_t centroidSet;
+	setCentroids(centroids, bands, measure, threshold, pBounds, sampleCount, centroidSet);
+
+	labels.resize(sampleCount);
+	std::vector<assignTile_t> tiles;
+	for (size_t firstPixel = 0; firstPixel < sampleCount; firstPixel += SAMPLE_TILE)
+	{
+		assignTile_t tile;
+		tile.pRasterElement = NULL;
+		tile.pCentroids = &centroidSet;
+		tile.startRow = 0;
+		tile.rowCount = 1;
+		tile.pLabels = &labels[firstPixel];
+		tile.pNearest = (pBounds != NULL) ? &pBounds->nearest[firstPixel] : NULL;
+		tile.pUpper = (pBounds != NULL) ? &pBounds->upper[firstPixel] : NULL;
+		tile.pLower = (pBounds != NULL) ? &pBounds->lower[firstPixel] : NULL;
+		tile.pSamples = &samples[firstPixel*bands];
+		tile.sampleCount = static_cast<unsigned int>(std::min<size_t>(SAMPLE_TILE, sampleCount - firstPixel));
+		tile.success = false;
+		tiles.push_back(tile);
+	}
+
+	stats.assign(centroidSet.count, clusterStats_t(bands));
+	const unsigned int batchSize = getBatchSize();
+	for (unsigned int first = 0; first < tiles.size(); first += batchSize)
+	{
+		std::vector<assignTile_t>::iterator batchEnd = tiles.begin() + std::min<size_t>(first + batchSize, tiles.size());
+		processInParallel(tiles.begin() + first, batchEnd, processTile);
+		for (std::vector<assignTile_t>::iterator tile = tiles.begin() + first; tile != batchEnd; ++tile)
+		{
+			mergeStats(*tile, stats);
+		}
+	}
+}
+
+double centroidDistance(const double* pA, const double* pB, unsigned int bands, DistanceMeasure measure)
+{
+	double dot = 0.0;
+	double normA = 0.0;
+	double normB = 0.0;
+	double distance = 0.0;
+	for (unsigned int band = 0; band < bands; ++band)
+	{
+		dot += pA[band]*pB[band];
+		normA += pA[band]*pA[band];
+		normB += pB[band]*pB[band];
+		distance += (pA[band] - pB[band])*(pA[band] - pB[band]);
+	}
+	if (measure == EUCLIDEAN_DISTANCE)
+	{
+		return sqrt(distance);
+	}
+	// There is no angle to a zero vector, it is infinitely far.
+	return (normA == 0.0 || normB == 0.0) ? infinity() : angle(dot/sqrt(normA*normB));
+}
+
+void moveBounds(assignmentBounds_t& bounds, const std::vector<double>& oldCentroids,
+	const std::vector<double>& newCentroids, const std::vector<int>& successors, unsigned int bands,
+	DistanceMeasure measure)
+{
+	VERIFYNRV(bands > 0);
+	const unsigned int oldCount = oldCentroids.size()/bands;
+	const unsigned int newCount = newCentroids.size()/bands;
+	VERIFYNRV(successors.size() == oldCount);
+
+	// Distance from each old centroid to the centroid that took over its pixels
+	std::vector<double> move(oldCount, infinity());
+	for (unsigned int i = 0; i < oldCount; ++i)
+	{
+		if (successors[i] >= 0)
+		{
+			move[i] = centroidDistance(&oldCentroids[i*bands], &newCentroids[successors[i]*bands], bands, measure);
+		}
+	}
+
+	// Every new centroid is related to the old centroid nearest to it. The distance from a pixel to the new
+	// centroid is at least the lower bound of the pixel minus their distance, unless the pixel belonged to
+	// that old centroid. Then it is at least their distance minus the upper bound of the pixel.
+	double maxDrift = 0.0;
+	std::vector<double> siblingDistance(oldCount, infinity());
+	for (unsigned int j = 0; j < newCount; ++j)
+	{
+		unsigned int origin = 0;
+		double drift = infinity();
+		for (unsigned int i = 0; i < oldCount; ++i)
+		{
+			const double distance = centroidDistance(&oldCentroids[i*bands], &newCentroids[j*bands], bands, measure);
+			if (distance < drift)
+			{
+				drift = distance;
+				origin = i;
+			}
+		}
+		maxDrift = std::max(maxDrift, drift);
+		if (successors[origin] != static_cast<int>(j))
+		{
+			siblingDistance[origin] = std::min(siblingDistance[origin], drift);
+		}
+	}
+
+	for (std::vector<int>::size_type pixel = 0; pixel < bounds.nearest.size(); ++pixel)
+	{
+		const int nearest = bounds.nearest[pixel];
+		if (nearest < 0)
+		{
+			continue;
+		}
+		if (successors[nearest] < 0)
+		{
+			bounds.nearest[pixel] = -1;
+			continue;
+		}
+		const double upper = bounds.upper[pixel];
+		bounds.nearest[pixel] = successors[nearest];
+		bounds.upper[pixel] = upperBound(upper + move[nearest]);
+		bounds.lower[pixel] = lowerBound(std::min(bounds.lower[pixel] - maxDrift, siblingDistance[nearest] - upper));
+	}
+}
@@ -0,0 +1,150 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef CLUSTERASSIGNMENT_H
+#define CLUSTERASSIGNMENT_H
+
+#include <vector>
+
+class ProgressTracker;
+class RasterElement;
+
+// Measure used to find the nearest centroid of a pixel
+enum DistanceMeasure
+{
+	SPECTRAL_ANGLE,
+	EUCLIDEAN_DISTANCE
+};
+
+// Label of the pixels that are not within the threshold of any centroid
+const int NO_MATCH = -1;
+
+// Statistics of the pixels assigned to a centroid. The sums are of the offsets of the pixels from
+// that centroid rather than of the pixels themselves, which keeps the variance accurate.
+struct clusterStats_t
+{
+	clusterStats_t(unsigned int bands = 0) : count(0), sum(bands, 0.0), sumSquares(bands, 0.0), sumDistance(0.0)
+	{}
+
+	void merge(const clusterStats_t& other)
+	{
+		count += other.count;
+		for (std::vector<double>::size_type band = 0; band < sum.size(); ++band)
+		{
+			sum[band] += other.sum[band];
+			sumSquares[band] += other.sumSquares[band];
+		}
+		sumDistance += other.sumDistance;
+	}
+
+	unsigned int count;
+	std::vector<double> sum;
+	std::vector<double> sumSquares;
+	// Sum of the euclidean distances of the pixels from the centroid
+	double sumDistance;
+};
+
+// Distance bounds of every pixel kept between the passes of the accelerated assignment (Hamerly's
+// algorithm). A pixel whose upper bound is below its lower bound and half the distance from its
+// centroid to the nearest other centroid keeps its centroid without computing the other distances.
+struct assignmentBounds_t
+{
+	// Index of the nearest centroid, also for pixels beyond the threshold, or -1 when unknown
+	std::vector<int> nearest;
+	// Upper bound of the distance to the nearest centroid
+	std::vector<float> upper;
+	// Lower bound of the distance to every other centroid
+	std::vector<float> lower;
+};
+
+/**
+* Assigns every pixel of the raster to its nearest centroid and collects the statistics of
+* every cluster in the same pass over the raster.
+*
+* @param pRasterElement
+*        The raster whose pixels are clustered.
+* @param centroids
+*        The centroids, one row of band count values per centroid.
+* @param measure
+*        Spectral angle or euclidean distance between a pixel and a centroid.
+* @param threshold
+*        Pixels farther than this from every centroid are labelled NO_MATCH. It is in degrees for
+*        the spectral angle, 0 labels every pixel with its nearest centroid.
+* @param labels
+*        Receives the index of the nearest centroid of every pixel, row after row.
+* @param stats
+*        Receives the statistics of the pixels assigned to each centroid.
+* @param pBounds
+*        The bounds of the accelerated assignment, updated by the pass. They are initialized when empty.
+*        Every distance is computed when NULL.
+* @return false if the raster could not be read.
+*
+*/
+bool assignPixels(RasterElement* pRasterElement, const std::vector<double>& centroids, DistanceMeasure measure,
+	double threshold, std::vector<int>& labels, std::vector<clusterStats_t>& stats, assignmentBounds_t* pBounds,
+	ProgressTracker& progress);
+
+/**
+* Draws a uniform random sample of the pixels of the raster, stratified by tile. The sample is the same
+* every time for the same raster.
+*
+* @param pRasterElement
+*        The raster whose pixels are sampled.
+* @param sampleSize
+*        The number of pixels to sample. Every tile contributes in proportion to its pixels, rounded up.
+* @param samples
+*        Receives the sampled pixels as floats, one row of band count values per pixel.
+* @return false if the raster could not be read.
+*
+*/
+bool samplePixels(RasterElement* pRasterElement, unsigned int sampleSize, std::vector<float>& samples,
+	ProgressTracker& progress);
+
+/**
+* Assigns every pixel of a sample to its nearest centroid and collects the statistics of every cluster,
+* like assignPixels() does for a whole raster.
+*
+* @param samples
+*        The pixels, one row of band count values per pixel.
+* @param bands
+*        The number of values of a pixel.
+*
+*/
+void assignSamples(const std::vector<float>& samples, unsigned int bands, const std::vector<double>& centroids,
+	DistanceMeasure measure, double threshold, std::vector<int>& labels, std::vector<clusterStats_t>& stats,
+	assignmentBounds_t* pBounds);
+
+// Distance between two centroids of band count values, in degrees for the spectral angle. A zero centroid
+// is infinitely far from every centroid in spectral angle.
+double centroidDistance(const double* pA, const double* pB, unsigned int bands, DistanceMeasure measure);
+
+/**
+* Carries the bounds of the accelerated assignment over to a new set of centroids, using the triangle
+* inequality with the distance every centroid moved.
+*
+* @param bounds
+*        The bounds of the last pass, with the old centroids.
+* @param oldCentroids
+*        The centroids of the last pass, one row of band count values per centroid.
+* @param newCentroids
+*        The centroids of the next pass. Centroids can have moved, been added, removed or merged.
+* @param successors
+*        Index in newCentroids of the centroid that took over the pixels of each old centroid,
+*        -1 for removed centroids.
+* @param bands
+*        The number of values of a centroid.
+* @param measure
+*        The measure of the bounds.
+*
+*/
+void moveBounds(assignmentBounds_t& bounds, const std::vector<double>& oldCentroids,
+	const std::vector<double>& newCentroids, const std::vector<int>& successors, unsigned int bands,
+	DistanceMeasure measure);
+
+#endif
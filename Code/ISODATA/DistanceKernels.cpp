@@ -0,0 +1,120 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#include "ClusterAssignment.h"
+#include "DistanceKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const double PI = 3.14159265358979323846;
+};
+
+void setCentroidBlock(const double* pCentroids, unsigned int count, unsigned int bands, bool normalize,
+	centroidBlock_t& block)
+{
+	block.count = count;
+	block.bands = bands;
+	block.values.resize(static_cast<size_t>(count)*bands);
+	for (unsigned int c = 0; c < count; ++c)
+	{
+		const double* pCentroid = pCentroids + static_cast<size_t>(c)*bands;
+		double scale = 1.0;
+		if (normalize)
+		{
+			double norm = 0.0;
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				norm += pCentroid[band]*pCentroid[band];
+			}
+			scale = (norm > 0.0) ? 1.0/sqrt(norm) : 1.0;
+		}
+		for (unsigned int band = 0; band < bands; ++band)
+		{
+			block.values[static_cast<size_t>(band)*count + c] = static_cast<float>(pCentroid[band]*scale);
+		}
+	}
+}
+
+void squaredDistances(const float* pPixels, unsigned int pixelCount, const centroidBlock_t& centroids,
+	float* pDistances)
+{
+	const unsigned int count = centroids.count;
+	const unsigned int bands = centroids.bands;
+	for (unsigned int pixel = 0; pixel < pixelCount; ++pixel, pPixels += bands, pDistances += count)
+	{
+		std::fill(pDistances, pDistances + count, 0.0f);
+		const float* pValues = &centroids.values[0];
+		for (unsigned int band = 0; band < bands; ++band, pValues += count)
+		{
+			const float value = pPixels[band];
+			for (unsigned int c = 0; c < count; ++c)
+			{
+				const float offset = value - pValues[c];
+				pDistances[c] += offset*offset;
+			}
+		}
+	}
+}
+
+float squaredDistance(const float* pPixel, const centroidBlock_t& centroids, unsigned int centroid)
+{
+	const float* pValues = &centroids.values[centroid];
+	float distance = 0.0f;
+	for (unsigned int band = 0; band < centroids.bands; ++band, pValues += centroids.count)
+	{
+		const float offset = pPixel[band] - *pValues;
+		distance += offset*offset;
+	}
+	return distance;
+}
+
+void normalizePixels(float* pPixels, unsigned int pixelCount, unsigned int bands, float* pNorms)
+{
+	for (unsigned int pixel = 0; pixel < pixelCount; ++pixel, pPixels += bands)
+	{
+		double norm = 0.0;
+		for (unsigned int band = 0; band < bands; ++band)
+		{
+			norm += static_cast<double>(pPixels[band])*pPixels[band];
+		}
+		pNorms[pixel] = static_cast<float>(sqrt(norm));
+		if (norm > 0.0)
+		{
+			const float scale = static_cast<float>(1.0/sqrt(norm));
+			for (unsigned int band = 0; band < bands; ++band)
+			{
+				pPixels[band] *= scale;
+			}
+		}
+	}
+}
+
+double unitAngle(double squaredDistance)
+{
+	return 2.0*asin(std::min(1.0, 0.5*sqrt(squaredDistance)))*180.0/PI;
+}
+
+void accumulateOffsets(const float* pPixel, const double* pCentroid, unsigned int bands, clusterStats_t& stats)
+{
+	double* pSum = &stats.sum[0];
+	double* pSumSquares = &stats.sumSquares[0];
+	double distance = 0.0;
+	for (unsigned int band = 0; band < bands; ++band)
+	{
+		const double offset = pPixel[band] - pCentroid[band];
+		pSum[band] += offset;
+		pSumSquares[band] += offset*offset;
+		distance += offset*offset;
+	}
+	stats.count++;
+	stats.sumDistance += sqrt(distance);
+}
@@ -0,0 +1,124 @@
+/*
+* The information in this file is
+* Copyright(c) 2012, Himanshu Singh <91.himanshu@gmail.com>
+* and is subject to the terms and conditions of the
+* GNU Lesser General Public License Version 2.1
+* The license text is available from   
+* http://www.gnu.org/licenses/lgpl.html
+*/
+
+#ifndef DISTANCEKERNELS_H
+#define DISTANCEKERNELS_H
+
+#include <vector>
+
+struct clusterStats_t;
+
+// The kernels compare a block of pixels, stored pixel after pixel as floats, with a block of centroids.
+// Their inner loops have no dependency between iterations so that the compiler vectorizes them for the
+// instruction set of the build.
+
+// Centroids laid out band after band, so that the kernels run their inner loops over the centroids
+struct centroidBlock_t
+{
+	unsigned int count;
+	unsigned int bands;
+	// Value of band b of centroid c at b*count + c
+	std::vector<float> values;
+};
+
+/**
+* Converts the values of a tile of pixels to float, once for all the kernels run on the tile.
+*
+* @param pValues
+*        The values, pixel after pixel.
+* @param count
+*        The number of values.
+* @param pFloats
+*        Receives the values.
+*
+*/
+template<typename T>
+void convertToFloat(const T* pValues, unsigned int count, float* pFloats)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		pFloats[i] = static_cast<float>(pValues[i]);
+	}
+}
+
+/**
+* Lays out centroids for the kernels.
+*
+* @param pCentroids
+*        The centroids, one row of band count values per centroid.
+* @param count
+*        The number of centroids.
+* @param bands
+*        The number of values of a centroid.
+* @param normalize
+*        Scales the centroids to unit length, to compare them with normalized pixels. Zero centroids are
+*        left unchanged.
+* @param block
+*        Receives the centroids.
+*
+*/
+void setCentroidBlock(const double* pCentroids, unsigned int count, unsigned int bands, bool normalize,
+	centroidBlock_t& block);
+
+/**
+* Computes the squared euclidean distances from a block of pixels to every centroid.
+*
+* @param pPixels
+*        The pixels, band count values per pixel.
+* @param pixelCount
+*        The number of pixels.
+* @param centroids
+*        The centroids.
+* @param pDistances
+*        Receives centroid count distances per pixel.
+*
+*/
+void squaredDistances(const float* pPixels, unsigned int pixelCount, const centroidBlock_t& centroids,
+	float* pDistances);
+
+// Squared euclidean distance from one pixel to one centroid of the block
+float squaredDistance(const float* pPixel, const centroidBlock_t& centroids, unsigned int centroid);
+
+/**
+* Scales pixels to unit length, so that the squared distances between them and normalized centroids give
+* the spectral angles. Zero pixels are left unchanged.
+*
+* @param pPixels
+*        The pixels, band count values per pixel.
+* @param pixelCount
+*        The number of pixels.
+* @param bands
+*        The number of values of a pixel.
+* @param pNorms
+*        Receives the length of every pixel.
+*
+*/
+void normalizePixels(float* pPixels, unsigned int pixelCount, unsigned int bands, float* pNorms);
+
+// Spectral angle in degrees between two unit vectors from their squared euclidean distance. Unlike the
+// arc cosine of their dot product, it stays accurate for small angles in single precision.
+double unitAngle(double squaredDistance);
+
+/**
+* Adds the offsets of a pixel from the centroid it is assigned to to the statistics of the cluster, from
+* which the mean and the variance of the cluster are computed.
+*
+* @param pPixel
+*        The pixel.
+* @param pCentroid
+*        The centroid of the cluster.
+* @param bands
+*        The number of values of the pixel.
+* @param stats
+*        The statistics of the cluster.
+*
+*/
+void accumulateOffsets(const float* pPixel, const double* pCentroid, unsigned int bands, clusterStats_t& stats);
+
+#endif
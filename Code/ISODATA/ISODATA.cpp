@@ -7,10 +7,8 @@
 * http://www.gnu.org/licenses/lgpl.html
 */
 
-#include "AoiElement.h"
-#include "AoiLayer.h"
 #include "AppVerify.h"
-#include "BitMaskIterator.h"
+#include "ColorType.h"
 #include "DataAccessor.h"
 #include "DataAccessorImpl.h"
 #include "DataElementGroup.h"
@@ -24,7 +22,6 @@
 #include "PlugInArgList.h"
 #include "PlugInManagerServices.h"
 #include "PlugInRegistration.h"
-#include "PlugInResource.h"
 #include "ProgressTracker.h"
 #include "PseudocolorLayer.h"
 #include "RasterDataDescriptor.h"
@@ -35,11 +32,14 @@
 #include "SpatialDataView.h"
 #include "SpectralUtilities.h"
 #include "ML_Tools_Version.h"
+#include "CentroidDistances.h"
+#include "CentroidSeeding.h"
 #include "ISODATA.h"
 #include "ISODATADlg.h"
 
 #include <QtCore/QTime>
 #include <QtCore/QString>
+#include <QtGui/QColor>
 #include <QtGui/QInputDialog>
 #include <QtGui/QMessageBox>
 
@@ -52,81 +52,8 @@ REGISTER_PLUGIN_BASIC(SpectralISODATA, ISODATA);
 
 namespace
 {
-	/**
-	* Calculated euclidean distance between cluster centre and given point.
-	*
-	* @param pixel
-	*        The pixel that is part of the cluster whose centroid is @centre.
-	* @param centre
-	*        The centre of the cluster from which distances are calculated.
-	* @param distance
-	*        The results are stored in this variable;
-	* @return void.
-	*
-	*/
-	template<typename T>
-	void pixelDistance(T* pixel, std::vector<double>& centre, double &distance)
-	{
-		for (std::vector<double>::size_type band = 0; band < centre.size(); ++band)
-		{
-			distance += (centre[band] - pixel[band])*(centre[band] - pixel[band]);
-		}
-		distance = sqrt(distance);
-
-	}
-
-	double pixelDistance(std::vector<double>& A, std::vector<double>& B)
-	{
-		double distance = 0.0;
-		for (std::vector<double>::size_type band = 0; band < B.size(); ++band)
-		{
-			distance += (A[band] - B[band])*(A[band] - B[band]);
-		}
-		return distance;
-	}
-
-	double pixelDistance(Signature* A, Signature* B)
-	{
-		double distance = 0.0;
-		std::vector<double> Ad;
-		std::vector<double> Bd;
-		DataVariant reflectance;
-		reflectance = A->getData("Reflectance");
-		reflectance.getValue(Ad);
-		reflectance = B->getData("Reflectance");
-		reflectance.getValue(Bd);
-		for (std::vector<double>::size_type band = 0; band < Bd.size(); ++band)
-		{
-			distance += (Ad[band] - Bd[band])*(Ad[band] - Bd[band]);
-		}
-		distance = sqrt(distance);
-		return distance;
-	}
-
-	/**
-	* Used to calculated variance between cluster centre and the point in the cluster.
-	* This function is called for every point in the cluster
-	*
-	* @param pixel
-	*        The pixel that is part of the cluster whose centroid is @centre.
-	* @param centre
-	*        The centre of the cluster from which distances are calculated.
-	* @param variance
-	*        This parameter is updated everytime the function is called with variance.
-	* @param numPoints
-	*        Number of points that are present in the cluster.
-	* @return void.
-	*
-	*/
-	template<typename T>
-	void calculateVariance(T* pixel, std::vector<double>& centre, std::vector<double>& variance, int &numPoints)
-	{
-		for (std::vector<double>::size_type band = 0; band < centre.size(); ++band)
-		{
-			variance[band] += (centre[band] - pixel[band])*(centre[band] - pixel[band])/numPoints;
-		}
-
-	}
+	// Number of pixels sampled to choose the initial centroids when the iterations run on every pixel
+	const unsigned int SEEDING_SAMPLE_SIZE = 20000;
 
 	/**
 	* Calculates the Maximum Standard Deviation and its index from the given variance.
@@ -153,25 +80,16 @@ namespace
 		return std::make_pair(MaxSTDV, IndexofMaxSTDV);
 	}
 
-	// Used when intercluster distances are calculated
-	struct pairDist_t
+	DataAccessor getRowAccessor(RasterElement* pRasterElement, unsigned int startRow, unsigned int endRow, bool writable)
 	{
-		double dist;
-		int a, b;
-		pairDist_t(double _dist, int _a, int _b) : dist(_dist), a(_a), b(_b)
-		{}
-		bool operator<(pairDist_t toCompare)  const                  
-		{
-			return  (dist < toCompare.dist);
-
-		}
-		bool operator<(double toCompare) const
-		{
-			return (dist < toCompare);
-		} 
-
-	};
-
+		const RasterDataDescriptor* pDescriptor =
+			static_cast<const RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
+		FactoryResource<DataRequest> request;
+		request->setInterleaveFormat(BIP);
+		request->setRows(pDescriptor->getActiveRow(startRow), pDescriptor->getActiveRow(endRow));
+		request->setWritable(writable);
+		return pRasterElement->getDataAccessor(request.release());
+	}
 };
 ISODATA::ISODATA()
 {
@@ -193,8 +111,26 @@ bool ISODATA::getInputSpecification(PlugInArgList*& pInArgList)
 	VERIFY(pInArgList = Service<PlugInManagerServices>()->getPlugInArgList());
 	VERIFY(pInArgList->addArg<Progress>(ProgressArg(), NULL));
 	VERIFY(pInArgList->addArg<SpatialDataView>(ViewArg()));
+	VERIFY(pInArgList->addArg<std::string>("Distance Measure", std::string("Spectral Angle"),
+		"Spectral Angle or Euclidean Distance between the pixels and the cluster centers."));
+	VERIFY(pInArgList->addArg<bool>("Accelerated Assignment", true,
+		"Keep distance bounds of every pixel to skip most distance computations after the first iterations."));
+	VERIFY(pInArgList->addArg<unsigned int>("Sample Size", static_cast<unsigned int>(0), "The iterations only "
+		"assign a random sample of this many pixels, stratified by tile, and every pixel is labelled once with "
+		"the final cluster centers. 0 uses Sample Fraction."));
+	VERIFY(pInArgList->addArg<double>("Sample Fraction", static_cast<double>(0.0), "Fraction of the pixels "
+		"sampled when Sample Size is 0. 0 runs the iterations on every pixel."));
+	VERIFY(pInArgList->addArg<std::string>("Initialization", std::string("K-Means++"), "How the initial "
+		"cluster centers are chosen from a sample of pixels: Random Pixels, K-Means++ or Principal Axis Splitting."));
+	VERIFY(pInArgList->addArg<int>("Random Seed", static_cast<int>(0),
+		"Seed for the sampling of the initial cluster centers, the same seed reproduces a run."));
+	VERIFY(pInArgList->addArg<double>("Center Shift Tolerance", static_cast<double>(0.0), "The iterations stop "
+		"when no cluster was removed, split or merged and no cluster center moved more than this, in degrees for "
+		"the spectral angle."));
+	VERIFY(pInArgList->addArg<double>("Reassigned Fraction Tolerance", static_cast<double>(0.0), "The iterations "
+		"stop when no cluster was removed, split or merged and at most this fraction of the pixels changed cluster."));
 	VERIFY(pInArgList->addArg<double>("SAMThreshold", static_cast<double>(85.0),
-		"SAM Threshold. Default is 85.0."));
+		"Maximum spectral angle in degrees between a pixel and its cluster center. Default is 85.0."));
 	VERIFY(pInArgList->addArg<double>("Maximum STDV", static_cast<double>(0.0),
 		"Maximum Standard Deviation of points from their cluster centers along each axis."));
 	VERIFY(pInArgList->addArg<double>("Minimum Centre Distance", static_cast<double>(0.0),
@@ -222,6 +158,10 @@ bool ISODATA::getOutputSpecification(PlugInArgList*& pOutArgList)
 		"Raster element resulting from the Clustering."));
 	VERIFY(pOutArgList->addArg<PseudocolorLayer>("ISODATA Results Layer", NULL,
 		"Pseudocolor layer resulting from the clustering."));
+	VERIFY(pOutArgList->addArg<unsigned int>("Iterations", static_cast<unsigned int>(0),
+		"Number of iterations that were run."));
+	VERIFY(pOutArgList->addArg<double>("Sum of Squared Distances", static_cast<double>(0.0),
+		"Sum of the squared euclidean distances of the pixels from their final cluster centers."));
 	return true;
 }
 
@@ -247,6 +187,22 @@ bool ISODATA::getInputArguments(PlugInArgList* pInArgList)
 		return false;
 	}
 
+	VERIFY(pInArgList->getPlugInArgValue("Distance Measure", distanceMeasure) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Accelerated Assignment", acceleratedAssignment) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Sample Size", sampleSize) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Sample Fraction", sampleFraction) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Initialization", initialization) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Random Seed", randomSeed) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Center Shift Tolerance", shiftTolerance) == true);
+
+	VERIFY(pInArgList->getPlugInArgValue("Reassigned Fraction Tolerance", reassignedTolerance) == true);
+
 	VERIFY(pInArgList->getPlugInArgValue("SAMThreshold", SAMThreshold) == true);
 	if (SAMThreshold <= 0.0)
 	{
@@ -255,6 +211,11 @@ bool ISODATA::getInputArguments(PlugInArgList* pInArgList)
 	}
 
 	VERIFY(pInArgList->getPlugInArgValue("Maximum Iterations", MaxIterations) == true);
+	if (MaxIterations == 0)
+	{
+		progress.report("Invalid maximum iterations.", 0, ERRORS, true);
+		return false;
+	}
 
 	VERIFY(pInArgList->getPlugInArgValue("Initial Clusters", NumClus) == true);
 	if (NumClus <= 0)
@@ -286,14 +247,17 @@ bool ISODATA::getInputArguments(PlugInArgList* pInArgList)
 	// Show interavtive dialog if  the application is not running in Batch Mode.
 	if (isBatch() == false)
 	{
-		ISODATADlg ISODATADlg(SAMThreshold, MaxIterations, NumClus,
-			Lump, MaxSTDV, SamPrm, MaxPair, Service<DesktopServices>()->getMainWidget());
+		ISODATADlg ISODATADlg(distanceMeasure, acceleratedAssignment, SAMThreshold, MaxIterations, NumClus,
+			Lump, MaxSTDV, SamPrm, MaxPair, sampleSize, sampleFraction, initialization, randomSeed,
+			shiftTolerance, reassignedTolerance, Service<DesktopServices>()->getMainWidget());
 
 		if (ISODATADlg.exec() != QDialog::Accepted)
 		{
 			progress.report("Unable to obtain input parameters.", 0, ABORT, true);
 			return false;
 		}
+		distanceMeasure = ISODATADlg.getDistanceMeasure();
+		acceleratedAssignment = ISODATADlg.getAcceleratedAssignment();
 		SAMThreshold = ISODATADlg.getSAMThreshold();
 		MaxIterations = ISODATADlg.getMaxIterations();
 		NumClus = ISODATADlg.getNumClus();
@@ -301,6 +265,43 @@ bool ISODATA::getInputArguments(PlugInArgList* pInArgList)
 		MaxSTDV = ISODATADlg.getMaxSTDV();
 		SamPrm = ISODATADlg.getSamPrm();
 		MaxPair = ISODATADlg.getMaxPair();
+		sampleSize = ISODATADlg.getSampleSize();
+		sampleFraction = ISODATADlg.getSampleFraction();
+		initialization = ISODATADlg.getInitialization();
+		randomSeed = ISODATADlg.getRandomSeed();
+		shiftTolerance = ISODATADlg.getShiftTolerance();
+		reassignedTolerance = ISODATADlg.getReassignedTolerance();
+	}
+
+	if (shiftTolerance < 0.0)
+	{
+		progress.report("Invalid center shift tolerance.", 0, ERRORS, true);
+		return false;
+	}
+
+	if (reassignedTolerance < 0.0 || reassignedTolerance > 1.0)
+	{
+		progress.report("Invalid reassigned fraction tolerance.", 0, ERRORS, true);
+		return false;
+	}
+
+	if (initialization != "Random Pixels" && initialization != "K-Means++" &&
+		initialization != "Principal Axis Splitting")
+	{
+		progress.report("Invalid initialization.", 0, ERRORS, true);
+		return false;
+	}
+
+	if (sampleFraction < 0.0 || sampleFraction > 1.0)
+	{
+		progress.report("Invalid sample fraction.", 0, ERRORS, true);
+		return false;
+	}
+
+	if (distanceMeasure != "Spectral Angle" && distanceMeasure != "Euclidean Distance")
+	{
+		progress.report("Invalid distance measure.", 0, ERRORS, true);
+		return false;
 	}
 	return true;
 }
@@ -329,28 +330,6 @@ bool ISODATA::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 		progress.report("Invalid raster data descriptor.", 0, ERRORS, true);
 		return false;
 	}
-	//Select the initial NumClus centroids randomly.
-	//The centroids are signatures and spectral distance is used to cluster them.
-	for (unsigned int i = 0; i < NumClus; ++i)
-	{
-		Opticks::PixelLocation location(rand() % pDescriptor->getColumnCount(), rand() % pDescriptor->getRowCount());
-		Signature* pSignature = SpectralUtilities::getPixelSignature(pRasterElement, location);
-
-		if (pSignature == NULL)
-		{
-			progress.report("Failed to get pixel signature.", 0, ERRORS, true);
-			return false;
-		}
-		centroids.push_back(pSignature);
-	}
-	//Load the SAM plugin, SAM is used to cluster points using spectral distance
-	ExecutableResource pSam("SAM", std::string(), progress.getCurrentProgress());
-	if (pSam.get() == NULL)
-	{
-		progress.report("SAM is not available.", 0, ERRORS, true);
-		return false;
-	}
-
 	//Delete Previous results if any and create new result element
 	ModelResource<DataElementGroup> pResultElement(dynamic_cast<DataElementGroup*>(Service<ModelServices>()->getElement(
 		resultsName, TypeConverter::toString<DataElementGroup>(), pRasterElement)));
@@ -364,17 +343,77 @@ bool ISODATA::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 		return false;
 	}
 
-	//Centroids for first iteration.
-	ModelResource<SignatureSet> pSignatureSet(dynamic_cast<SignatureSet*>(Service<ModelServices>()->createElement(
-		"Centroids for Iteration 1", TypeConverter::toString<SignatureSet>(), pResultElement.get())));
-	if (pSignatureSet.get() == NULL)
+	const DistanceMeasure measure = (distanceMeasure == "Euclidean Distance") ? EUCLIDEAN_DISTANCE : SPECTRAL_ANGLE;
+	const unsigned int bandCount = pDescriptor->getBandCount();
+	const double threshold = (measure == SPECTRAL_ANGLE) ? SAMThreshold : 0.0;
+
+	// With sampling the iterations only assign a random sample of the pixels, which is read once. Every
+	// pixel is labelled once with the final centroids.
+	const size_t pixelCount = static_cast<size_t>(pDescriptor->getRowCount())*pDescriptor->getColumnCount();
+	unsigned int sampleCount = sampleSize;
+	if (sampleCount == 0)
 	{
-		progress.report("Unable to create signature set.", 0, ERRORS, true);
+		sampleCount = static_cast<unsigned int>(std::min<double>(pixelCount, ceil(sampleFraction*pixelCount)));
+	}
+	std::vector<float> samples;
+	if (sampleCount > 0 && sampleCount < pixelCount)
+	{
+		if (samplePixels(pRasterElement, sampleCount, samples, progress) == false)
+		{
+			return false;
+		}
+	}
+	// The number of points of a cluster of the sample is scaled to the whole raster before it is compared
+	// with SamPrm.
+	const double pointScale = samples.empty() ? 1.0 : static_cast<double>(pixelCount)*bandCount/samples.size();
+
+	// Choose the initial NumClus centroids from the sample, or from a sample of their own when the
+	// iterations run on every pixel.
+	std::vector<float> seedingSamples;
+	if (samples.empty())
+	{
+		if (samplePixels(pRasterElement, std::max(SEEDING_SAMPLE_SIZE, 100*NumClus), seedingSamples,
+			progress) == false)
+		{
+			return false;
+		}
+	}
+	const SeedingMethod seedingMethod = (initialization == "Random Pixels") ? RANDOM_PIXELS :
+		((initialization == "Principal Axis Splitting") ? PRINCIPAL_AXIS_SPLITTING : KMEANS_PLUS_PLUS);
+	// The centroids are kept one row of band count values per centroid. They only become signatures
+	// once they are final.
+	std::vector<double> centroids;
+	seedCentroids(samples.empty() ? seedingSamples : samples, bandCount, NumClus, seedingMethod, measure,
+		static_cast<unsigned int>(randomSeed), centroids);
+	std::vector<float>().swap(seedingSamples);
+	if (centroids.empty())
+	{
+		progress.report("Unable to choose the initial cluster centers.", 0, ERRORS, true);
 		return false;
 	}
 
 	//The number of clusters (Set to Initial number of clusters).
-	unsigned int clusters = NumClus;
+	unsigned int clusters = centroids.size()/bandCount;
+
+	// Index of the nearest centroid of every pixel and the number of centroids the pixels were assigned to.
+	std::vector<int> labels;
+	unsigned int labelCount = 0;
+
+	// Bounds of the accelerated assignment, the centroids of the last assignment and the index of the
+	// new centroid that took over the pixels of each of them.
+	assignmentBounds_t bounds;
+	std::vector<double> previousValues;
+	std::vector<int> successors;
+
+	// Distances between the centroids of the last assignment, kept for the lump step.
+	centroidDistances_t centroidDistances;
+
+	// Labels of the last assignment, to count the pixels that changed cluster. Once an iteration has
+	// converged, the next assignment is the last one.
+	std::vector<int> previousLabels;
+	bool converged = false;
+	unsigned int iterations = 0;
+	std::vector<clusterStats_t> clusterStats;
 
 	// Begin iterations
 	for (unsigned int iterationNumber = 1; iterationNumber <= MaxIterations; ++iterationNumber)
@@ -389,47 +428,64 @@ bool ISODATA::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 			progress.report("Invalid argument values supplied", 0, ABORT, true);
 		}
 
-		// Insert the centroids into the signature set.
-		if (pSignatureSet->insertSignatures(centroids) == false)
+		// Assign every pixel to its nearest centroid and collect the statistics of the clusters. Like SAM,
+		// pixels whose spectral angle to every centroid exceeds SAMThreshold are not assigned to any cluster.
+		labelCount = centroids.size()/bandCount;
+		if (acceleratedAssignment && !previousValues.empty())
 		{
-			progress.report("Unable to add centroids to signature set.", 0, ERRORS, true);
-			return false;
+			moveBounds(bounds, previousValues, centroids, successors, bandCount, measure);
 		}
-
-		PseudocolorLayer* pSamLayer = runSamOnCentroids(pSam, pSignatureSet.get(), iterationNumber, pRasterElement);
-		if (pSamLayer == NULL)
+		moveCentroidDistances(centroidDistances, previousValues, centroids, successors, bandCount);
+		if (samples.empty())
 		{
-			return false;
+			if (assignPixels(pRasterElement, centroids, measure, threshold, labels, clusterStats,
+				acceleratedAssignment ? &bounds : NULL, progress) == false)
+			{
+				return false;
+			}
 		}
-		Service<ModelServices>()->setElementParent(pSamLayer->getDataElement(), pResultElement.get());
-
-		// Force a new signature set to be created.
-		ModelResource<SignatureSet> pNewSignatureSet(dynamic_cast<SignatureSet*>(
-			Service<ModelServices>()->createElement(
-			QString("Centroids for Iteration %1").arg(iterationNumber + 1).toStdString(),
-			TypeConverter::toString<SignatureSet>(), pResultElement.get())));
-		if (pNewSignatureSet.get() == NULL)
+		else
 		{
-			progress.report("Unable to create new signature set.", 0, ERRORS, true);
-			return false;
+			assignSamples(samples, bandCount, centroids, measure, threshold, labels, clusterStats,
+				acceleratedAssignment ? &bounds : NULL);
 		}
+		previousValues = centroids;
+		iterations = iterationNumber;
 
-		//Clear the old centroids.
-		centroids.clear();
-
-		//Class IDs generated by SAM
-		std::vector <int> classIds;
-		pSamLayer->getClassIDs(classIds);
+		// The centroids of the final iteration are not updated any more, they only label the pixels.
+		if (iterationNumber == MaxIterations || converged)
+		{
+			break;
+		}
 
-		// Hide all classes.
-		for (std::vector<int>::const_iterator iter = classIds.begin(); iter != classIds.end(); ++iter)
+		// Fraction of the pixels that changed cluster, following the pixels of every old centroid to the
+		// centroid that took them over.
+		double reassignedFraction = 1.0;
+		if (previousLabels.size() == labels.size() && labels.empty() == false)
 		{
-			pSamLayer->setClassDisplayed(*iter, false);
+			size_t reassigned = 0;
+			for (std::vector<int>::size_type pixel = 0; pixel < labels.size(); ++pixel)
+			{
+				const int previous = (previousLabels[pixel] == NO_MATCH) ? NO_MATCH : successors[previousLabels[pixel]];
+				if (previous != labels[pixel])
+				{
+					++reassigned;
+				}
+			}
+			reassignedFraction = static_cast<double>(reassigned)/labels.size();
 		}
+		previousLabels = labels;
+
+		// The new centroids are computed from the centroids the pixels were assigned to.
+		centroids.clear();
 
 		// Indicates if rest of the iteration is to be skipped.
 		int repeat = 0;
 
+		// Set when a cluster is removed, split or merged, and the largest distance a centroid moved.
+		bool clustersChanged = false;
+		double maxShift = 0.0;
+
 		// Average distances of points from thier centroids.
 		std::vector<double> average;
 		double totalAvg = 0.0;
@@ -442,164 +498,80 @@ bool ISODATA::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 		// Index is requied to calculate new centroids if the original cluster is split.
 		std::vector<std::pair<double, int> > maxCentroidSTDV;
 
-		// Show a class and obtain AOI from it.
-		// Use the obtained AOI to find the number of points in a cluster and
+		// Use the statistics to find the number of points in a cluster and
 		// generate new centroids from clusters having >= SamPrm.
-		for (unsigned int i = 0; i < classIds.size(); ++i)
+		successors.assign(labelCount, -1);
+		for (unsigned int i = 0; i < labelCount; ++i)
 		{
-			// Display the class so that it will be included in the derived AOI.
-			pSamLayer->setClassDisplayed(classIds[i], true);
-
-			// Derive an AOI from the pseudocolor layer.
-			AoiLayer* pAoiLayer = dynamic_cast<AoiLayer*>(pView->deriveLayer(pSamLayer, AOI_LAYER));
-			if (pAoiLayer == NULL)
+			const clusterStats_t& stats = clusterStats[i];
+			// Check for empty cluster -- no pixel was assigned to this centroid.
+			if (stats.count == 0)
 			{
-				progress.report("Failed to derive AOI from pseudocolor layer.", 0, ERRORS, true);
-				return false;
+				clustersChanged = true;
+				continue;
 			}
-
-			// Use a ModelResource so pAoiLayer gets deleted when pAoiElement goes out of scope.
-			ModelResource<AoiElement> pAoiElement(dynamic_cast<AoiElement*>(pAoiLayer->getDataElement()));
-			if (pAoiElement.get() == NULL)
+			// If the number of points are less than the minimum required
+			if (stats.count*pointScale < SamPrm)
 			{
-				progress.report("Failed to obtain AOI element from layer.", 0, ERRORS, true);
-				return false;
+				repeat = 1;
+				// Decrement the number of clusters
+				clusters--;
+				//Ignore this cluster i.e. Don't add this to the list of new centroids.
+				continue;
 			}
 
-			// Obtain iterator over the AOI layer
-			BitMaskIterator iterator(pAoiElement->getSelectedPoints(), pRasterElement);
-			// Check for empty AOI -- an empty AOI implies that  "Indeterminate" or "No Match" results were found.
-			if (iterator != iterator.end())
+			// The new centroid is the mean of the points of the cluster and the variance is taken around it.
+			// The sums are of the offsets of the points from the centroid they were assigned to.
+			std::vector<double> centroidValue(bandCount);
+			std::vector<double> variance(bandCount);
+			for (unsigned int band = 0; band < bandCount; ++band)
 			{
-				// If the number of points are less than the minimum required
-				if (iterator.getCount() < SamPrm)
-				{
-					repeat = 1;
-					// Decrement the number of clusters
-					clusters--;
-					//Ignore this cluster i.e. Don't add this to the list of new centroids.
-					//Hide this class
-					pSamLayer->setClassDisplayed(classIds[i], false);
-					continue;
-				}
-				// Compute the centroid for the class.
-				// These signatures will be used next iteration.
-				ModelResource<Signature> pSignature(dynamic_cast<Signature*>(Service<ModelServices>()->createElement(
-					QString("ISODATA Iteration %1: Centroid %2").arg(iterationNumber + 1).arg(centroids.size() + 1).toStdString(),
-					TypeConverter::toString<Signature>(), pNewSignatureSet.get())));
-				if (pSignature.get() == NULL)
-				{
-					progress.report("Failed to create new signature for centroid.", 0, ERRORS, true);
-					return false;
-				}
+				const double meanOffset = stats.sum[band]/stats.count;
+				centroidValue[band] = previousValues[i*bandCount + band] + meanOffset;
+				variance[band] = std::max(0.0, stats.sumSquares[band]/stats.count - meanOffset*meanOffset);
+			}
+			maxShift = std::max(maxShift, centroidDistance(&previousValues[i*bandCount], &centroidValue[0],
+				bandCount, measure));
 
-				if (SpectralUtilities::convertAoiToSignature(pAoiElement.get(), pSignature.get(),
-					pRasterElement, progress.getCurrentProgress(), &mAborted) == false)
-				{
-					progress.report("Failed to derive AOI from pseudocolor layer.", 0, ERRORS, true);
-					return false;
-				}
-				centroids.push_back(pSignature.release());
-
-				// Compute the Average distances of pixels from the centroid.
-				// Access the reflectence of centroid and for each pixel caluclate the distance from it.
-				// Accumulate  for all pixel in the cluster and divide by the numbe of pixels
-				// Note: All the calculations are performed by assuming each point to be a bandCount() dimensional vector
-				//       and finding the euclidean distance.
-
-				// Acquire centroid's reflectence values
-				Signature* pCentroidSignature = centroids.back();
-				std::vector <double> centroidValue;
-				DataVariant reflectanceVariant = pCentroidSignature->getData("Reflectance");
-				reflectanceVariant.getValue(centroidValue);
-
-				int startRow = iterator.getBoundingBoxStartRow();
-				int endRow = iterator.getBoundingBoxEndRow();
-				int startCol = iterator.getBoundingBoxStartColumn();
-				int endCol = iterator.getBoundingBoxEndColumn();
-
-				FactoryResource<DataRequest> request;
-				request->setInterleaveFormat(BIP);
-				request->setRows(pDescriptor->getActiveRow(startRow),
-					pDescriptor->getActiveRow(endRow));
-				request->setColumns(pDescriptor->getActiveColumn(startCol),
-					pDescriptor->getActiveColumn(endCol));
-				DataAccessor accessor = pRasterElement->getDataAccessor(request.release());
-				VERIFY(accessor.isValid());
-
-				// Number of points in the cluster
-				numPoints.push_back(iterator.getCount());
-				totalPoints += numPoints.back();
-
-				//variance for this centroid
-				std::vector<double> variance(pDescriptor->getBandCount(), 0.0);
-
-				// Sum of distances from cluster points to the centroid
-				double sumDist = 0.0;
-				for (int row = startRow; row <= endRow; row++) 
-				{
-					if (isAborted() == true)
-					{
-						progress.report("User Aborted.", 0, ABORT, true);
-						return false;
-					}
-					progress.report(QString("Calculating Average Distance and Maximum STDV for Centroid %1").arg(centroids.size()).toStdString(),
-						(100*row)/(endRow-startRow+1), NORMAL, true);
-
-					for (int col = startCol; col <= endCol; col++) 
-					{
-						//If the pixel is present in cluster
-						if (iterator.getPixel(col, row)) 
-						{
-							accessor->toPixel(row, col);
-							VERIFY(accessor.isValid());
-							double distance = 0.0;
-							switchOnEncoding(pDescriptor->getDataType(), pixelDistance, accessor->getColumn(), centroidValue, distance);
-							sumDist += distance;
-
-							switchOnEncoding(pDescriptor->getDataType(), calculateVariance, accessor->getColumn(), centroidValue,
-								variance, numPoints.back());
-						}
-					}
-				}
-				totalAvg += sumDist;
-				double avg = sumDist/numPoints.back();
-				average.push_back(avg);
+			// These centroids will be used next iteration.
+			centroids.insert(centroids.end(), centroidValue.begin(), centroidValue.end());
+			successors[i] = centroids.size()/bandCount - 1;
 
-				maxCentroidSTDV.push_back(calculateMaxSTDVfromVariance(variance));
-			}
-			//Hide this class
-			pSamLayer->setClassDisplayed(classIds[i], false);
-		}
+			// Number of points in the cluster
+			numPoints.push_back(stats.count);
+			totalPoints += numPoints.back();
 
-		// Overall average of distances from cluster centres
-		totalAvg = totalAvg/totalPoints;
+			// Average euclidean distance of the points from the centroid they were assigned to.
+			totalAvg += stats.sumDistance;
+			average.push_back(stats.sumDistance/numPoints.back());
+
+			maxCentroidSTDV.push_back(calculateMaxSTDVfromVariance(variance));
+		}
 
-		// Show all classes.
-		for (std::vector<int>::const_iterator iter = classIds.begin(); iter != classIds.end(); ++iter)
+		if (centroids.empty())
 		{
-			pSamLayer->setClassDisplayed(*iter, true);
+			progress.report("No cluster has the minimum number of points.", 0, ERRORS, true);
+			return false;
 		}
 
+		// Overall average of distances from cluster centres
+		totalAvg = totalAvg/totalPoints;
+
 		// If there were clusters with < SamPrm points then start new iteration.
 		if (repeat)
 		{
-			// Hide previous layer.
-			pView->hideLayer(pSamLayer);
-			pSignatureSet.release();
-			pSignatureSet = ModelResource<SignatureSet>(pNewSignatureSet.release());
 			continue;
 		}
 
 		// Execute steps 5-8 if the condition below is true.
-		if ((iterationNumber != MaxIterations) && (2*clusters <= NumClus || iterationNumber%2) && (clusters < 2*NumClus))
+		if ((2*clusters <= NumClus || iterationNumber%2) && (clusters < 2*NumClus))
 		{
 			// Index of centroids of clusters that are going to be split.
 			std::vector<int> toSplit;
 			// Check and centroids that will be split.
-			for (unsigned int c = 0; c < centroids.size(); c++)
+			for (unsigned int c = 0; c < centroids.size()/bandCount; c++)
 			{
-				if ((maxCentroidSTDV[c].first > MaxSTDV) && ((average[c] > totalAvg && numPoints[c] > 2*(SamPrm + 1))
+				if ((maxCentroidSTDV[c].first > MaxSTDV) && ((average[c] > totalAvg && numPoints[c]*pointScale > 2*(SamPrm + 1))
 					|| (clusters <= NumClus/2)))
 				{
 					toSplit.push_back(c);
@@ -615,30 +587,16 @@ bool ISODATA::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 			{
 				int cindex = toSplit[s];
 
-				std::vector<double> originalReflectance;
-				DataVariant reflectanceVariant = centroids[cindex]->getData("Reflectance");
-				reflectanceVariant.getValue(originalReflectance);
+				std::vector<double> originalReflectance(centroids.begin() + cindex*bandCount,
+					centroids.begin() + (cindex + 1)*bandCount);
 				// For the first centroid
 				double changeFactor = 0.5*maxCentroidSTDV[cindex].first;
 
-				originalReflectance[maxCentroidSTDV[cindex].second] -= changeFactor;
+				centroids[cindex*bandCount + maxCentroidSTDV[cindex].second] -= changeFactor;
 
-				centroids[cindex]->setData("Reflectance", originalReflectance);
-
-				// Obtain new signature for the second centroid
-				ModelResource<Signature> pSignature(dynamic_cast<Signature*>(Service<ModelServices>()->createElement(
-					QString("ISODATA Iteration %1: Centroid %2 (split from Centroid %3)").arg(iterationNumber + 1).arg(centroids.size() + 1).arg(cindex + 1).toStdString(),
-					TypeConverter::toString<Signature>(), pNewSignatureSet.get())));
-				if (pSignature.get() == NULL)
-				{
-					progress.report("Failed to create new signature for centroid.", 0, ERRORS, true);
-					return false;
-				}
-				originalReflectance[maxCentroidSTDV[cindex].second] += 2*changeFactor;
-				pSignature.get()->setData("Reflectance", originalReflectance);
-				pSignature.get()->setData("Wavelength", centroids[cindex]->getData("Wavelength"));
-				pSignature.get()->setData("BandNumber", centroids[cindex]->getData("BandNumber"));
-				centroids.push_back(pSignature.release());
+				// Append the second centroid
+				originalReflectance[maxCentroidSTDV[cindex].second] += changeFactor;
+				centroids.insert(centroids.end(), originalReflectance.begin(), originalReflectance.end());
 				// Increase cluster count
 				clusters++;
 			}
@@ -652,154 +610,235 @@ bool ISODATA::execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList)
 		// If the cluster was split
 		if (repeat)
 		{
-			pView->hideLayer(pSamLayer);
-			pSignatureSet.release();
-			pSignatureSet = ModelResource<SignatureSet>(pNewSignatureSet.release());
 			continue;
 		}
 
 		// Perform LUMP i.e. Merge those clusters whose inter-cluster distance is < Lump
-		// InterCluster distances are calculated and sorted in ascending order.
+		// The MaxPair closest pairs below Lump are found in ascending order of their inter-cluster distance.
+		// Only the distances that could have come below Lump since the last iterations are computed again.
 		// A maximum of MaxPair can be merged per iteration
+		progress.report("Computing inter-cluster distances", 0, NORMAL, true);
+		const unsigned int centroidCount = centroids.size()/bandCount;
+		std::vector<lumpPair_t> interClus;
+		findLumpPairs(centroidDistances, previousValues, centroids, successors, bandCount, Lump, MaxPair, interClus);
 
-		// If this is the final iteration set lump to zero.
-		if (iterationNumber == MaxIterations) Lump = 0;
-		std::vector<pairDist_t> interClus;
-		for (unsigned int a = 0; a < centroids.size(); a++)
-		{
-			progress.report("Computing inter-cluster distances", ((a+1)*100)/centroids.size(), NORMAL, true);
-			for (unsigned int b = a + 1; b < centroids.size(); b++)
-			{
-				interClus.push_back(pairDist_t(pixelDistance(centroids[a], centroids[b]), a, b));
-			}
-		}
-
-		// Sort the distances in ascending order
-		std::sort(interClus.begin(), interClus.end());
 		// True if a centoid is involved in a merger before
-		std::vector<bool> inMerge(centroids.size(), false);
-		unsigned int m, n;
-		// Take at most MaxPair
-		for (m = 0, n = 1; m < interClus.size() && n <= MaxPair; m++, n++)
+		std::vector<bool> inMerge(centroidCount, false);
+		// Index of the centroid each merged centroid was merged into
+		std::vector<int> mergedInto(centroidCount, -1);
+		for (unsigned int m = 0; m < interClus.size(); m++)
 		{
-			progress.report("Checking for pairs to merge", (n*100)/std::min(MaxPair,interClus.size()), NORMAL, true);
+			progress.report("Checking for pairs to merge", ((m + 1)*100)/interClus.size(), NORMAL, true);
 			int c1 = interClus[m].a, c2 = interClus[m].b;
-			// If the distance is less than Lump and the clusters were not involved in mergers before then merge clusters
-			if (interClus[m].dist < Lump && !inMerge[c1] && !inMerge[c2])
+			// If the clusters were not involved in mergers before then merge clusters
+			if (!inMerge[c1] && !inMerge[c2])
 			{
 				inMerge[c1] = true; inMerge[c2] = true;
-				// Obtain new signature for the centroid
-				ModelResource<Signature> pSignature(dynamic_cast<Signature*>(Service<ModelServices>()->createElement(
-					QString("ISODATA Iteration %1: Centroid from merging %2 and %3").arg(iterationNumber + 1).arg(c1 + 1).arg(c2 + 1).toStdString(),
-					TypeConverter::toString<Signature>(), pNewSignatureSet.get())));
-				if (pSignature.get() == NULL)
-				{
-					progress.report("Failed to create new signature for centroid.", 0, ERRORS, true);
-					return false;
-				}
+				clustersChanged = true;
+				mergedInto[c1] = centroids.size()/bandCount; mergedInto[c2] = centroids.size()/bandCount;
 
 				// Reflectance of new centroid will be (Na*Za + Nb*Zb)/(Na + Nb) where Ni is number of point in cluster and Zi is reflectance.
-				std::vector<double> Za, Zb;
+				const double* Za = &centroids[c1*bandCount];
+				const double* Zb = &centroids[c2*bandCount];
 				int Na = numPoints[c1], Nb = numPoints[c2];
-				DataVariant reflectanceVariant = centroids[c1]->getData("Reflectance");
-				reflectanceVariant.getValue(Za);
-				reflectanceVariant = centroids[c2]->getData("Reflectance");
-				reflectanceVariant.getValue(Zb);
 
 				// Result
-				std::vector<double> result(Za.size());
-				for (unsigned int z = 0; z < Za.size(); z++)
+				std::vector<double> result(bandCount);
+				for (unsigned int z = 0; z < bandCount; z++)
 				{
 					result[z] = (Na*Za[z] + Nb*Zb[z])/(Na + Nb);
 				}
-				pSignature->setData("Reflectance", result);
-				pSignature->setData("Wavelength", centroids[c1]->getData("Wavelength"));
-				pSignature->setData("BandNumber", centroids[c1]->getData("BandNumber"));
-				// Insert the merged centroid
-				centroids.push_back(pSignature.release());
+				// Append the merged centroid
+				centroids.insert(centroids.end(), result.begin(), result.end());
 				// Decrease cluster count
 				clusters--;
 			}
 		}
+		// The pixels of merged centroids now belong to the centroid they were merged into.
+		// Find where every centroid will be after the merged ones are erased.
+		std::vector<int> remaining(centroids.size()/bandCount, -1);
+		for (unsigned int c = 0, next = 0; c < remaining.size(); c++)
+		{
+			if (c >= inMerge.size() || inMerge[c] == false)
+			{
+				remaining[c] = next++;
+			}
+		}
+		for (unsigned int i = 0; i < successors.size(); i++)
+		{
+			if (successors[i] >= 0)
+			{
+				successors[i] = remaining[inMerge[successors[i]] ? mergedInto[successors[i]] : successors[i]];
+			}
+		}
+
 		// Erase those points which were merged in the last steps i.e inMerge
 		for (int m = inMerge.size() - 1; m >= 0; m--)
 		{
 			if (inMerge[m] == true)
 			{
-				centroids.erase(centroids.begin() + m);
+				centroids.erase(centroids.begin() + m*bandCount, centroids.begin() + (m + 1)*bandCount);
 			}
 		}
 
-		if (iterationNumber != MaxIterations) 
+		// When no cluster changed and the centroids hardly moved or few pixels changed cluster, the next
+		// assignment labels the pixels for the last time.
+		if (clustersChanged == false && (maxShift <= shiftTolerance || reassignedFraction <= reassignedTolerance))
 		{
-			pView->hideLayer(pSamLayer);
-			pSignatureSet.release();
-			pSignatureSet = ModelResource<SignatureSet>(pNewSignatureSet.release());
+			converged = true;
 		}
-		else
+
+	}
+
+	// The final centroids only labelled the sample, label every pixel with them.
+	if (samples.empty() == false)
+	{
+		if (assignPixels(pRasterElement, previousValues, measure, threshold, labels, clusterStats, NULL,
+			progress) == false)
 		{
-			pResultElement.release();
-			pSignatureSet.release();
-
-			// Rename the final result layer and its data element.
-			pSamLayer->rename(resultsName + " Layer");
-			Service<ModelServices>()->setElementName(pSamLayer->getDataElement(), resultsName + " Element");
-			Service<ModelServices>()->setElementName(pSignatureSet.get(), resultsName + " Centroids");
-			// Set output arguments.
-			if (pOutArgList != NULL)
-			{
-				pOutArgList->setPlugInArgValue<DataElementGroup>("ISODATA Result",
-					dynamic_cast<DataElementGroup*>(pResultElement.get()));
-				pOutArgList->setPlugInArgValue<RasterElement>("ISODATA Results Element",
-					dynamic_cast<RasterElement*>(pSamLayer->getDataElement()));
-				pOutArgList->setPlugInArgValue<PseudocolorLayer>("ISODATA Results Layer", pSamLayer);
-			}
+			return false;
+		}
+	}
+
+	// Sum of the squared distances of the pixels from their final centroids. The sums of squares are of the
+	// offsets from the centroids the pixels were assigned to.
+	double cost = 0.0;
+	for (std::vector<clusterStats_t>::const_iterator stats = clusterStats.begin(); stats != clusterStats.end(); ++stats)
+	{
+		for (unsigned int band = 0; band < bandCount; ++band)
+		{
+			cost += stats->sumSquares[band];
 		}
 	}
 
-	progress.report("ISODATA complete", 100, NORMAL);
+	// Label the pixels with the final centroids.
+	PseudocolorLayer* pResultsLayer = createResultsLayer(pRasterElement, labels, labelCount, pResultElement.get());
+	if (pResultsLayer == NULL)
+	{
+		return false;
+	}
+	if (createCentroidSignatures(pRasterElement, previousValues, iterations, pResultElement.get()) == false)
+	{
+		return false;
+	}
+	DataElementGroup* pResultGroup = pResultElement.release();
+
+	// Set output arguments.
+	if (pOutArgList != NULL)
+	{
+		pOutArgList->setPlugInArgValue<DataElementGroup>("ISODATA Result", pResultGroup);
+		pOutArgList->setPlugInArgValue<RasterElement>("ISODATA Results Element",
+			dynamic_cast<RasterElement*>(pResultsLayer->getDataElement()));
+		pOutArgList->setPlugInArgValue<PseudocolorLayer>("ISODATA Results Layer", pResultsLayer);
+		pOutArgList->setPlugInArgValue<unsigned int>("Iterations", &iterations);
+		pOutArgList->setPlugInArgValue<double>("Sum of Squared Distances", &cost);
+	}
+
+	progress.report(QString("ISODATA %1 after %2 iterations, sum of squared distances %3")
+		.arg(converged ? "converged" : "complete").arg(iterations).arg(cost).toStdString(), 100, NORMAL);
 	progress.upALevel();
 	return true;
 }
 
-PseudocolorLayer* ISODATA::runSamOnCentroids(ExecutableResource& pSam, SignatureSet* target, int iterationNumber, RasterElement* pRasterElement)
+bool ISODATA::createCentroidSignatures(RasterElement* pRasterElement, const std::vector<double>& centroids,
+	unsigned int iteration, DataElement* pParent)
 {
-	// Call SAM on the centroids.
-		PlugInArgList& samInput = pSam->getInArgList();
-		std::string samResultsName = resultsName + QString(" for Iteration %1").arg(iterationNumber).toStdString();
-		bool samSuccess = samInput.setPlugInArgValue<Signature>("Target Signatures", target);
-		samSuccess &= samInput.setPlugInArgValue<RasterElement>(DataElementArg(), pRasterElement);
-		samSuccess &= samInput.setPlugInArgValue<std::string>("Results Name", &samResultsName);
-		samSuccess &= samInput.setPlugInArgValue<double>("Threshold", &SAMThreshold);
-		samSuccess &= samInput.setPlugInArgValue<bool>("Display Results", &samSuccess);
-		samSuccess &= pSam->execute();
-		if (samSuccess == false)
-		{
-			progress.report("SAM failed to execute.", 0, ERRORS, true);
-			return NULL;
-		}
-		// Extract SAM results
-		PlugInArgList& samOutput = pSam->getOutArgList();
-		RasterElement* pSamResults = samOutput.getPlugInArgValue<RasterElement>("Sam Results");
-		if (pSamResults == NULL)
-		{
-			progress.report("SAM failed to return valid results.", 0, ERRORS, true);
-			return NULL;
-		}
+	const RasterDataDescriptor* pDescriptor =
+		static_cast<const RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
+	const unsigned int bandCount = pDescriptor->getBandCount();
+
+	ModelResource<SignatureSet> pSignatureSet(dynamic_cast<SignatureSet*>(Service<ModelServices>()->createElement(
+		resultsName + " Centroids", TypeConverter::toString<SignatureSet>(), pParent)));
+	if (pSignatureSet.get() == NULL)
+	{
+		progress.report("Unable to create signature set.", 0, ERRORS, true);
+		return false;
+	}
+
+	// The centroids have the wavelengths of a pixel signature, which are read once for all of them.
+	ModelResource<Signature> pPixelSignature(
+		SpectralUtilities::getPixelSignature(pRasterElement, Opticks::PixelLocation(0, 0)));
+	if (pPixelSignature.get() == NULL)
+	{
+		progress.report("Failed to get pixel signature.", 0, ERRORS, true);
+		return false;
+	}
+	const DataVariant wavelength = pPixelSignature->getData("Wavelength");
+	const DataVariant bandNumber = pPixelSignature->getData("BandNumber");
 
-		// Retrieve the SAM pseudocolor result layer.
-		LayerList* pLayerList = pView->getLayerList();
-		if (pLayerList == NULL)
+	std::vector<Signature*> signatures;
+	for (std::vector<double>::size_type first = 0; first < centroids.size(); first += bandCount)
+	{
+		ModelResource<Signature> pSignature(dynamic_cast<Signature*>(Service<ModelServices>()->createElement(
+			QString("ISODATA Iteration %1: Centroid %2").arg(iteration).arg(signatures.size() + 1).toStdString(),
+			TypeConverter::toString<Signature>(), pSignatureSet.get())));
+		if (pSignature.get() == NULL)
 		{
-			progress.report("Failed to access SAM results layer list.", 0, ERRORS, true);
-			return NULL;
+			progress.report("Failed to create new signature for centroid.", 0, ERRORS, true);
+			return false;
 		}
+		pSignature->setData("Reflectance",
+			std::vector<double>(centroids.begin() + first, centroids.begin() + first + bandCount));
+		pSignature->setData("Wavelength", wavelength);
+		pSignature->setData("BandNumber", bandNumber);
+		signatures.push_back(pSignature.release());
+	}
+	if (pSignatureSet->insertSignatures(signatures) == false)
+	{
+		progress.report("Unable to add centroids to signature set.", 0, ERRORS, true);
+		return false;
+	}
+	pSignatureSet.release();
+	return true;
+}
 
-		PseudocolorLayer* pSamLayer = dynamic_cast<PseudocolorLayer*>(pLayerList->getLayer(PSEUDOCOLOR, pSamResults));
-		if (pSamLayer == NULL)
+PseudocolorLayer* ISODATA::createResultsLayer(RasterElement* pRasterElement, const std::vector<int>& labels,
+	unsigned int classCount, DataElement* pParent)
+{
+	const RasterDataDescriptor* pDescriptor =
+		static_cast<const RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
+	const unsigned int rowCount = pDescriptor->getRowCount();
+	const unsigned int colCount = pDescriptor->getColumnCount();
+
+	// Cluster i is stored as i + 1, the pixels that were not assigned to any cluster are 0.
+	ModelResource<RasterElement> pResults(RasterUtilities::createRasterElement(resultsName + " Element",
+		rowCount, colCount, INT4SBYTES, true, pParent));
+	if (pResults.get() == NULL)
+	{
+		progress.report("Unable to create results element.", 0, ERRORS, true);
+		return NULL;
+	}
+	DataAccessor accessor = getRowAccessor(pResults.get(), 0, rowCount - 1, true);
+	if (accessor.isValid() == false)
+	{
+		progress.report("Unable to access results element.", 0, ERRORS, true);
+		return NULL;
+	}
+	for (unsigned int row = 0; row < rowCount; ++row)
+	{
+		int* pResultRow = reinterpret_cast<int*>(accessor->getRow());
+		const int* pLabels = &labels[static_cast<size_t>(row)*colCount];
+		for (unsigned int col = 0; col < colCount; ++col)
 		{
-			progress.report("Failed to access SAM results layer.", 0, ERRORS, true);
-			return NULL;
+			pResultRow[col] = pLabels[col] + 1;
 		}
-		return pSamLayer;
+		accessor->nextRow();
+	}
+	pResults->updateData();
+
+	PseudocolorLayer* pLayer = dynamic_cast<PseudocolorLayer*>(pView->createLayer(PSEUDOCOLOR, pResults.get(),
+		resultsName + " Layer"));
+	if (pLayer == NULL)
+	{
+		progress.report("Unable to create results layer.", 0, ERRORS, true);
+		return NULL;
+	}
+	for (unsigned int c = 0; c < classCount; ++c)
+	{
+		QColor color = QColor::fromHsv((360*c)/classCount, 255, 255);
+		pLayer->addInitializedClass(QString("Cluster %1").arg(c + 1).toStdString(), c + 1,
+			ColorType(color.red(), color.green(), color.blue()));
+	}
+	pResults.release();
+	return pLayer;
 }
@@ -11,12 +11,12 @@
 #define ISODATA_H
 
 #include "AlgorithmShell.h"
+#include "ClusterAssignment.h"
 #include <string>
 #include <vector>
+class DataElement;
 class ProgressTracker;
 class PseudocolorLayer;
-class ExecutableResource;
-class SignatureSet;
 
 class ISODATA : public AlgorithmShell
 {
@@ -28,13 +28,22 @@ public:
     virtual bool execute(PlugInArgList* pInArgList, PlugInArgList* pOutArgList);
 private:
 	bool getInputArguments(PlugInArgList* pInArgList);
-	PseudocolorLayer* runSamOnCentroids(ExecutableResource& pSam, SignatureSet* target, int iterationNumber, RasterElement* pRasterElement);
-	void performLumping();
+	PseudocolorLayer* createResultsLayer(RasterElement* pRasterElement, const std::vector<int>& labels,
+		unsigned int classCount, DataElement* pParent);
+	bool createCentroidSignatures(RasterElement* pRasterElement, const std::vector<double>& centroids,
+		unsigned int iteration, DataElement* pParent);
 
-	std::vector <Signature*> centroids;
 	ProgressTracker progress;
 	SpatialDataView* pView;
 	std::string resultsName;
+	std::string distanceMeasure;
+	bool acceleratedAssignment;
+	unsigned int sampleSize;
+	double sampleFraction;
+	std::string initialization;
+	int randomSeed;
+	double shiftTolerance;
+	double reassignedTolerance;
 	double SAMThreshold;
 	unsigned int MaxIterations;
 	unsigned int NumClus;
@@ -42,7 +51,6 @@ private:
 	double MaxSTDV;
 	double Lump;
 	int SamPrm;
-	unsigned int clusters;
 };
 
 #endif
@@ -9,6 +9,7 @@
 
 #include <QtCore/QString>
 #include <QtGui/QCheckBox>
+#include <QtGui/QComboBox>
 #include <QtGui/QDialogButtonBox>
 #include <QtGui/QFrame>
 #include <QtGui/QGridLayout>
@@ -22,14 +23,32 @@
 #include "ISODATADlg.h"
 
 #include <limits>
-ISODATADlg::ISODATADlg(double SAMThreshold, unsigned int MaxIterations, unsigned int NumClus, double Lump, 
-    double MaxSTDV, int SamPrm, unsigned int MaxPair, QWidget* pParent) : QDialog(pParent)
+ISODATADlg::ISODATADlg(const std::string& distanceMeasure, bool acceleratedAssignment, double SAMThreshold, unsigned int MaxIterations, unsigned int NumClus, double Lump, 
+    double MaxSTDV, int SamPrm, unsigned int MaxPair, unsigned int sampleSize, double sampleFraction,
+    const std::string& initialization, int randomSeed, double shiftTolerance, double reassignedTolerance,
+    QWidget* pParent) :
+    QDialog(pParent)
 {
     setModal(true);
     setWindowTitle("ISODATA");
 
+    QLabel* pDistanceMeasureLabel = new QLabel("Distance Measure", this);
+    pDistanceMeasureLabel->setToolTip("Measure used to assign each pixel to its nearest cluster center.");
+    mpDistanceMeasure = new QComboBox(this);
+    mpDistanceMeasure->addItem("Spectral Angle");
+    mpDistanceMeasure->addItem("Euclidean Distance");
+    mpDistanceMeasure->setEditable(false);
+    mpDistanceMeasure->setCurrentIndex(mpDistanceMeasure->findText(QString::fromStdString(distanceMeasure)));
+    mpDistanceMeasure->setToolTip(pDistanceMeasureLabel->toolTip());
+
+    mpAcceleratedAssignment = new QCheckBox("Accelerated Assignment", this);
+    mpAcceleratedAssignment->setChecked(acceleratedAssignment);
+    mpAcceleratedAssignment->setToolTip("Keep distance bounds of every pixel to skip most distance computations "
+        "after the first iterations. Needs 12 bytes of memory per pixel.");
+
     QLabel* pSAMThresholdLabel = new QLabel("SAM Threshold", this);
-    pSAMThresholdLabel->setToolTip("This threshold will be used for each run of the SAM algorithm.");
+    pSAMThresholdLabel->setToolTip("Maximum spectral angle in degrees between a pixel and its cluster center. "
+        "Only used with the Spectral Angle distance measure.");
     mpSAMThreshold = new QDoubleSpinBox(this);
     mpSAMThreshold->setValue(SAMThreshold);
     mpSAMThreshold->setDecimals(5);
@@ -41,7 +60,7 @@ ISODATADlg::ISODATADlg(double SAMThreshold, unsigned int MaxIterations, unsigned
     pMaxIterationsLabel->setToolTip("Maximumn number of iterations for which the algorithm will run.");
     mpMaxIterations = new QSpinBox(this);
     mpMaxIterations->setValue(MaxIterations);
-    mpMaxIterations->setMinimum(0);
+    mpMaxIterations->setMinimum(1);
     mpMaxIterations->setMaximum(std::numeric_limits<int>::max());
     mpMaxIterations->setToolTip(pMaxIterationsLabel->toolTip());
 
@@ -87,6 +106,65 @@ ISODATADlg::ISODATADlg(double SAMThreshold, unsigned int MaxIterations, unsigned
     mpMaxPair->setMaximum(std::numeric_limits<int>::max());
     mpMaxPair->setToolTip(pMaxPairLabel->toolTip());
 
+    QLabel* pSampleSizeLabel = new QLabel("Sample Size", this);
+    pSampleSizeLabel->setToolTip("The iterations only assign a random sample of this many pixels, stratified by "
+        "tile, and every pixel is labelled once with the final cluster centers. 0 uses the sample fraction.");
+    mpSampleSize = new QSpinBox(this);
+    mpSampleSize->setMinimum(0);
+    mpSampleSize->setMaximum(std::numeric_limits<int>::max());
+    mpSampleSize->setValue(sampleSize);
+    mpSampleSize->setToolTip(pSampleSizeLabel->toolTip());
+
+    QLabel* pSampleFractionLabel = new QLabel("Sample Fraction", this);
+    pSampleFractionLabel->setToolTip("Fraction of the pixels sampled when the sample size is 0. "
+        "0 runs the iterations on every pixel.");
+    mpSampleFraction = new QDoubleSpinBox(this);
+    mpSampleFraction->setDecimals(4);
+    mpSampleFraction->setMinimum(0.0);
+    mpSampleFraction->setMaximum(1.0);
+    mpSampleFraction->setSingleStep(0.01);
+    mpSampleFraction->setValue(sampleFraction);
+    mpSampleFraction->setToolTip(pSampleFractionLabel->toolTip());
+
+    QLabel* pInitializationLabel = new QLabel("Initialization", this);
+    pInitializationLabel->setToolTip("How the initial cluster centers are chosen from a sample of pixels.");
+    mpInitialization = new QComboBox(this);
+    mpInitialization->addItem("Random Pixels");
+    mpInitialization->addItem("K-Means++");
+    mpInitialization->addItem("Principal Axis Splitting");
+    mpInitialization->setEditable(false);
+    mpInitialization->setCurrentIndex(mpInitialization->findText(QString::fromStdString(initialization)));
+    mpInitialization->setToolTip(pInitializationLabel->toolTip());
+
+    QLabel* pRandomSeedLabel = new QLabel("Random Seed", this);
+    pRandomSeedLabel->setToolTip("The same seed chooses the same initial cluster centers.");
+    mpRandomSeed = new QSpinBox(this);
+    mpRandomSeed->setMinimum(0);
+    mpRandomSeed->setMaximum(std::numeric_limits<int>::max());
+    mpRandomSeed->setValue(randomSeed);
+    mpRandomSeed->setToolTip(pRandomSeedLabel->toolTip());
+
+    QLabel* pShiftToleranceLabel = new QLabel("Center Shift Tolerance", this);
+    pShiftToleranceLabel->setToolTip("The iterations stop when no cluster was removed, split or merged and no "
+        "cluster center moved more than this, in degrees for the spectral angle.");
+    mpShiftTolerance = new QDoubleSpinBox(this);
+    mpShiftTolerance->setDecimals(5);
+    mpShiftTolerance->setMinimum(0.0);
+    mpShiftTolerance->setMaximum(std::numeric_limits<double>::max());
+    mpShiftTolerance->setValue(shiftTolerance);
+    mpShiftTolerance->setToolTip(pShiftToleranceLabel->toolTip());
+
+    QLabel* pReassignedToleranceLabel = new QLabel("Reassigned Fraction Tolerance", this);
+    pReassignedToleranceLabel->setToolTip("The iterations stop when no cluster was removed, split or merged and "
+        "at most this fraction of the pixels changed cluster.");
+    mpReassignedTolerance = new QDoubleSpinBox(this);
+    mpReassignedTolerance->setDecimals(5);
+    mpReassignedTolerance->setMinimum(0.0);
+    mpReassignedTolerance->setMaximum(1.0);
+    mpReassignedTolerance->setSingleStep(0.001);
+    mpReassignedTolerance->setValue(reassignedTolerance);
+    mpReassignedTolerance->setToolTip(pReassignedToleranceLabel->toolTip());
+
     QFrame* pLine = new QFrame(this);
     pLine->setFrameStyle(QFrame::HLine | QFrame::Sunken);
     QDialogButtonBox* pButtonBox = new QDialogButtonBox(
@@ -94,23 +172,38 @@ ISODATADlg::ISODATADlg(double SAMThreshold, unsigned int MaxIterations, unsigned
 
     // Layout Begin
     QGridLayout* pLayout = new QGridLayout(this);
-    pLayout->addWidget(pSAMThresholdLabel, 0, 0);
-    pLayout->addWidget(mpSAMThreshold, 0, 1);
-    pLayout->addWidget(pMaxIterationsLabel, 1, 0);
-    pLayout->addWidget(mpMaxIterations, 1, 1);
-    pLayout->addWidget(pNumClusLabel, 2, 0);
-    pLayout->addWidget(mpNumClus, 2, 1);
-    pLayout->addWidget(pLumpLabel, 3, 0);
-    pLayout->addWidget(mpLump, 3, 1);
-    pLayout->addWidget(pMaxSTDVLabel, 4, 0);
-    pLayout->addWidget(mpMaxSTDV, 4, 1);
-    pLayout->addWidget(pSamPrmLabel, 5, 0);
-    pLayout->addWidget(mpSamPrm, 5, 1);
-    pLayout->addWidget(pMaxPairLabel, 6, 0);
-    pLayout->addWidget(mpMaxPair, 6, 1);
-    pLayout->addWidget(pLine, 7, 0, 1, 2);
-    pLayout->addWidget(pButtonBox, 8, 0, 1, 2);
-    pLayout->setRowStretch(8, 10);
+    pLayout->addWidget(pDistanceMeasureLabel, 0, 0);
+    pLayout->addWidget(mpDistanceMeasure, 0, 1);
+    pLayout->addWidget(mpAcceleratedAssignment, 1, 0, 1, 2);
+    pLayout->addWidget(pSAMThresholdLabel, 2, 0);
+    pLayout->addWidget(mpSAMThreshold, 2, 1);
+    pLayout->addWidget(pMaxIterationsLabel, 3, 0);
+    pLayout->addWidget(mpMaxIterations, 3, 1);
+    pLayout->addWidget(pNumClusLabel, 4, 0);
+    pLayout->addWidget(mpNumClus, 4, 1);
+    pLayout->addWidget(pLumpLabel, 5, 0);
+    pLayout->addWidget(mpLump, 5, 1);
+    pLayout->addWidget(pMaxSTDVLabel, 6, 0);
+    pLayout->addWidget(mpMaxSTDV, 6, 1);
+    pLayout->addWidget(pSamPrmLabel, 7, 0);
+    pLayout->addWidget(mpSamPrm, 7, 1);
+    pLayout->addWidget(pMaxPairLabel, 8, 0);
+    pLayout->addWidget(mpMaxPair, 8, 1);
+    pLayout->addWidget(pSampleSizeLabel, 9, 0);
+    pLayout->addWidget(mpSampleSize, 9, 1);
+    pLayout->addWidget(pSampleFractionLabel, 10, 0);
+    pLayout->addWidget(mpSampleFraction, 10, 1);
+    pLayout->addWidget(pInitializationLabel, 11, 0);
+    pLayout->addWidget(mpInitialization, 11, 1);
+    pLayout->addWidget(pRandomSeedLabel, 12, 0);
+    pLayout->addWidget(mpRandomSeed, 12, 1);
+    pLayout->addWidget(pShiftToleranceLabel, 13, 0);
+    pLayout->addWidget(mpShiftTolerance, 13, 1);
+    pLayout->addWidget(pReassignedToleranceLabel, 14, 0);
+    pLayout->addWidget(mpReassignedTolerance, 14, 1);
+    pLayout->addWidget(pLine, 15, 0, 1, 2);
+    pLayout->addWidget(pButtonBox, 16, 0, 1, 2);
+    pLayout->setRowStretch(16, 10);
     pLayout->setColumnStretch(2, 10);
     pLayout->setMargin(10);
     pLayout->setSpacing(5);
@@ -125,6 +218,16 @@ ISODATADlg::ISODATADlg(double SAMThreshold, unsigned int MaxIterations, unsigned
 ISODATADlg::~ISODATADlg()
 {}
 
+std::string ISODATADlg::getDistanceMeasure() const
+{
+    return mpDistanceMeasure->currentText().toStdString();
+}
+
+bool ISODATADlg::getAcceleratedAssignment() const
+{
+    return mpAcceleratedAssignment->isChecked();
+}
+
 double ISODATADlg::getSAMThreshold() const
 {
     return mpSAMThreshold->value();
@@ -159,3 +262,33 @@ unsigned int ISODATADlg::getMaxPair() const
 {
     return mpMaxPair->value();
 }
+
+unsigned int ISODATADlg::getSampleSize() const
+{
+    return mpSampleSize->value();
+}
+
+double ISODATADlg::getSampleFraction() const
+{
+    return mpSampleFraction->value();
+}
+
+std::string ISODATADlg::getInitialization() const
+{
+    return mpInitialization->currentText().toStdString();
+}
+
+int ISODATADlg::getRandomSeed() const
+{
+    return mpRandomSeed->value();
+}
+
+double ISODATADlg::getShiftTolerance() const
+{
+    return mpShiftTolerance->value();
+}
+
+double ISODATADlg::getReassignedTolerance() const
+{
+    return mpReassignedTolerance->value();
+}
@@ -12,7 +12,10 @@
 
 #include <QtGui/QDialog>
 
+#include <string>
+
 class QCheckBox;
+class QComboBox;
 class QDoubleSpinBox;
 class QSpinBox;
 
@@ -21,9 +24,11 @@ class ISODATADlg : public QDialog
     Q_OBJECT
 
 public:
-    ISODATADlg(double SAMThreshold, unsigned int MaxIterations, unsigned int NumClus, double Lump, double MaxSTDV, int SamPrm, unsigned int MaxPair, QWidget* pParent = NULL);
+    ISODATADlg(const std::string& distanceMeasure, bool acceleratedAssignment, double SAMThreshold, unsigned int MaxIterations, unsigned int NumClus, double Lump, double MaxSTDV, int SamPrm, unsigned int MaxPair, unsigned int sampleSize, double sampleFraction, const std::string& initialization, int randomSeed, double shiftTolerance, double reassignedTolerance, QWidget* pParent = NULL);
     virtual ~ISODATADlg();
 
+    std::string getDistanceMeasure() const;
+    bool getAcceleratedAssignment() const;
     double getSAMThreshold() const;
     unsigned int getMaxIterations() const;
     unsigned int getNumClus() const;
@@ -31,8 +36,16 @@ public:
     double getMaxSTDV() const;
     int getSamPrm() const;
     unsigned int getMaxPair() const;
+    unsigned int getSampleSize() const;
+    double getSampleFraction() const;
+    std::string getInitialization() const;
+    int getRandomSeed() const;
+    double getShiftTolerance() const;
+    double getReassignedTolerance() const;
 
 private:
+    QComboBox* mpDistanceMeasure;
+    QCheckBox* mpAcceleratedAssignment;
     QDoubleSpinBox* mpSAMThreshold;
     QSpinBox* mpMaxIterations;
     QSpinBox* mpNumClus;
@@ -40,6 +53,12 @@ private:
     QDoubleSpinBox* mpMaxSTDV;
     QSpinBox* mpSamPrm;
     QSpinBox* mpMaxPair;
+    QSpinBox* mpSampleSize;
+    QDoubleSpinBox* mpSampleFraction;
+    QComboBox* mpInitialization;
+    QSpinBox* mpRandomSeed;
+    QDoubleSpinBox* mpShiftTolerance;
+    QDoubleSpinBox* mpReassignedTolerance;
 };
 
 #endif
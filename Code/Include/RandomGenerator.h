@@ -0,0 +1,87 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2012 Himanshu Singh <91.himanshu@gmail.com>
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from   
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef RANDOMGENERATOR_H
+#define RANDOMGENERATOR_H
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * Small seeded pseudo random number generator (xorshift128).
+ *
+ * Unlike rand() the sequence only depends on the seed, so runs of the
+ * plug-ins can be reproduced on every platform, and each generator
+ * has its own state so generators can be used from different threads.
+ */
+class RandomGenerator
+{
+public:
+   RandomGenerator(unsigned int seed = 0)
+   {
+      setSeed(seed);
+   }
+
+   void setSeed(unsigned int seed)
+   {
+      // Spread the seed over the state, which must not be all zero.
+      unsigned int s = seed;
+      for (int i = 0; i < 4; ++i)
+      {
+         s = s*1812433253u + 0x9E3779B9u;
+         mState[i] = (s ^ (s >> 15)) | (i == 0 ? 1u : 0u);
+      }
+   }
+
+   /**
+    * @return A uniformly distributed 32 bit value.
+    */
+   unsigned int next()
+   {
+      unsigned int t = mState[0] ^ (mState[0] << 11);
+      mState[0] = mState[1];
+      mState[1] = mState[2];
+      mState[2] = mState[3];
+      mState[3] = mState[3] ^ (mState[3] >> 19) ^ t ^ (t >> 8);
+      return mState[3];
+   }
+
+   /**
+    * @return A uniformly distributed value in [0, 1).
+    */
+   double nextDouble()
+   {
+      return next()*(1.0/4294967296.0);
+   }
+
+   /**
+    * @return A uniformly distributed value in [0, n).
+    */
+   unsigned int nextIndex(unsigned int n)
+   {
+      return static_cast<unsigned int>(nextDouble()*n);
+   }
+
+   /**
+    * Fisher-Yates shuffle of the given values.
+    */
+   template<typename T>
+   void shuffle(std::vector<T>& values)
+   {
+      for (unsigned int i = values.size(); i > 1; --i)
+      {
+         std::swap(values[i - 1], values[nextIndex(i)]);
+      }
+   }
+
+private:
+   unsigned int mState[4];
+};
+
+#endif